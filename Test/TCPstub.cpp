@@ -10,18 +10,21 @@ TCPstub::TCPstub() :
   myIP(IPAddress(0, 0, 0, 0)),
   myPort(0),
   worker(nullptr),
+  connects(0),
   tm(nullptr) { }
 
 TCPstub::TCPstub(TCPstub& t) :
   myIP(t.myIP),
   myPort(t.myPort),
   worker(nullptr),
+  connects(0),
   tm(nullptr) { }
 
 TCPstub::TCPstub(IPAddress ip, uint16_t port) :
   myIP(ip),
   myPort(port),
   worker(nullptr),
+  connects(0),
   tm(nullptr) { }
 
 // Destructor
@@ -48,7 +51,8 @@ TCPstub& TCPstub::operator=(TCPstub& t) {
 }
 
 // Client.h method set
-// Connect will check the identity and only start the worker task if it is matching
+// Connect will check the identity and only start the worker task if it is matching.
+// A stub without identity (IP and port 0) will take any target.
 int TCPstub::connect(IPAddress ip, uint16_t port) {
   /*
   Serial.print("Identity: ");
@@ -60,11 +64,12 @@ int TCPstub::connect(IPAddress ip, uint16_t port) {
   Serial.print("/");
   Serial.println(port);
   */
-  if (ip == myIP && port == myPort) {
+  if ((ip == myIP && port == myPort) || (!myIP && !myPort)) {
     // if we do not have a worker already running
     if (!worker) {
       // Start task to handle the queue
       xTaskCreatePinnedToCore((TaskFunction_t)&workerTask, "TCPstub", 4096, this, 6, &worker, 1);
+      connects++;
     }
     return 0;
   }
@@ -191,21 +196,22 @@ void TCPstub::workerTask(TCPstub *instance) {
       uint8_t TCPhead[6];
       {
         lock_guard<mutex> lockIn(instance->inLock);
-        uint16_t i = 0;
         // Serial.print("Read  ");
-        // Keep the TCPhead and discard the rest.
-        while (!instance->inQueue.empty()) {
-          uint8_t byte = instance->inQueue.front();
-          if (i < 6) {
-            TCPhead[i++] = byte;
-          }
+        // Keep the TCPhead
+        for (uint8_t i = 0; i < 6; ++i) {
+          TCPhead[i] = instance->inQueue.front();
+          instance->inQueue.pop();
+          // Serial.printf("%02X ", TCPhead[i]);
+        }
+        // Discard the request behind it. More requests may follow, if the client is pipelining.
+        uint16_t len = (TCPhead[4] << 8) | TCPhead[5];
+        while (len-- && !instance->inQueue.empty()) {
           instance->inQueue.pop();
-          // Serial.printf("%02X ", byte);
         }
         // Serial.println((*instance->tm).size());
       }
       // Get the TID
-      tid = ((TCPhead[0] << 8) & 0xFF) | (TCPhead[1] & 0xFF);
+      tid = (TCPhead[0] << 8) | TCPhead[1];
 
       // Look for the tid in the TestCase map
       auto tc = (*instance->tm).find(tid);
@@ -213,17 +219,23 @@ void TCPstub::workerTask(TCPstub *instance) {
         // Get a handier pointer for the TestCase found
         TestCase *myTest(tc->second);
 
-        // Does the test case prescribe an initial delay?
-        if (myTest->delayTime) {
+        // Anything to be sent ahead of the response?
+        if (myTest->lead.size() > 0) {
+          // Yes. Send it as it is
+          lock_guard<mutex> lockOut(instance->outLock);
+          for (auto byte : myTest->lead) {
+            instance->outQueue.push(byte);
+          }
+        }
+
+        // Does the test case prescribe an initial delay? For split responses it is the pause between the parts
+        if (myTest->delayTime && !myTest->splitAt) {
           // Yes. idle until time has passed
           // Serial.printf("Wait for %d\n", myTest->delayTime);
           delay(myTest->delayTime);
         }
         // Do we have to send a response?
         if (myTest->response.size() > 0) {
-          // Yes, we do. Lock the outQueue, since we ar egoing to write to it
-          lock_guard<mutex> lockOut(instance->outLock);
-
           // Are we asked to fake the transaction ID?
           if (myTest->fakeTransactionID == true) {
             TCPhead[0] += 13;
@@ -233,22 +245,30 @@ void TCPstub::workerTask(TCPstub *instance) {
           TCPhead[4] = (myTest->response.size() << 8) & 0xFF;
           TCPhead[5] = myTest->response.size() & 0xFF;
 
-          // Serial.print("Write ");
-          // Write the TCP header
-          for (uint8_t i = 0; i < 6; ++i) {
-            instance->outQueue.push(TCPhead[i]);
-            // Serial.printf("%02X ", TCPhead[i]);
-          }
+          // Put together TCP header and response
+          ModbusMessage frame;
+          frame.add(TCPhead, 6);
+          frame.append(myTest->response);
 
-          // Now write the response
-          const uint8_t *cp = myTest->response.data();
-          size_t cnt = myTest->response.size();
-          while (cnt--) {
-            instance->outQueue.push(*cp);
-            // Serial.printf("%02X ", *cp);
-            cp++;
+          // Send it in one or two parts
+          size_t cut = (myTest->splitAt && myTest->splitAt < frame.size()) ? myTest->splitAt : frame.size();
+          {
+            // Lock the outQueue, since we are going to write to it
+            lock_guard<mutex> lockOut(instance->outLock);
+            // Serial.print("Write ");
+            for (size_t i = 0; i < cut; ++i) {
+              instance->outQueue.push(frame[i]);
+              // Serial.printf("%02X ", frame[i]);
+            }
+            // Serial.println();
+          }
+          if (cut < frame.size()) {
+            delay(myTest->delayTime);
+            lock_guard<mutex> lockOut(instance->outLock);
+            for (size_t i = cut; i < frame.size(); ++i) {
+              instance->outQueue.push(frame[i]);
+            }
           }
-          // Serial.println();
         }
         // Are we to stop ourselves after response has been sent?
         if (myTest->stopAfterResponding == true) {
@@ -33,6 +33,8 @@ struct TestCase {
   uint32_t delayTime;            // A time in ms to wait before the response is sent
   bool stopAfterResponding;      // if true, worker will kill itself after answering (simulate server disconnect)
   bool fakeTransactionID;        // if true, stub will use a wrong TID in response
+  ModbusMessage lead;            // byte sequence sent as it is ahead of delay and response, MBAP headers included
+  uint16_t splitAt;              // if >0, the response is sent in two parts: splitAt bytes (MBAP header included), then delayTime ms later the rest
 };
 
 // Short names for the test cases' maps
@@ -53,7 +55,8 @@ public:
   TCPstub& operator= (TCPstub& t);
 
 // Client.h method set
-  // Connect will check the identity and only start the worker task if it is matching
+  // Connect will check the identity and only start the worker task if it is matching.
+  // A stub without identity (IP and port 0) will take any target.
   int connect(IPAddress ip, uint16_t port);
 
   // We do not need hostnames here, so we will return EADDRNOTAVAIL (=99) to prevent use
@@ -88,10 +91,14 @@ public:
   // setIdentity changes the simulated host/port
   void setIdentity(IPAddress ip, uint16_t port);
 
+  // connectCount returns the number of connects that started a worker task
+  inline uint32_t connectCount() { return connects; }
+
 protected:
   IPAddress myIP;
   uint16_t  myPort;
   TaskHandle_t worker;
+  uint32_t connects;
   TidMap* tm;
   queue<uint8_t> inQueue;
   queue<uint8_t> outQueue;
@@ -15,6 +15,7 @@
 
 #include "TCPstub.h"
 #include "CoilData.h"
+#include "ModbusRequest.h"
 
 #define STRINGIFY(x) #x
 #define LNO(x) "line " STRINGIFY(x) " "
@@ -44,6 +45,11 @@ void RTStest(bool level) {
 // Test prerequisites
 TCPstub stub;
 ModbusClientTCP TestTCP(stub, 2);               // ModbusClientTCP test instance for stub use.
+TCPstub pipeStub;
+ModbusClientTCP PipeTCP(pipeStub, 10);          // ModbusClientTCP test instance for pipelining
+TCPstub poolStubA;
+TCPstub poolStubB;
+ModbusClientTCP PoolTCP(poolStubA, 10);         // ModbusClientTCP test instance for the connection pool
 WiFiClient wc;
 ModbusClientTCP TestClientWiFi(wc, 25);         // ModbusClientTCP test instance for WiFi loopback use.
 ModbusClientRTU RTUclient(GPIO_NUM_4);          // ModbusClientRTU test instance. Connect a LED to GPIO pin 4 to see the RTS toggle.
@@ -141,6 +147,81 @@ ModbusMessage FC06(ModbusMessage request) {
   return ECHO_RESPONSE;
 }
 
+// Worker function for function code 0x01: the coils are the bits of the test memory, LSB first
+ModbusMessage FC01(ModbusMessage request) {
+  uint16_t addr = 0;        // First coil to read
+  uint16_t coils = 0;       // Number of coils to read
+  ModbusMessage response;
+
+  request.get(2, addr, coils);
+
+  // Number of coils and address valid?
+  if (!coils || (addr + coils) > 32 * 16) {
+    // No. Return error response
+    response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_ADDRESS);
+    return response;
+  }
+
+  response.add(request.getServerID(), request.getFunctionCode(), (uint8_t)((coils + 7) / 8));
+
+  // Pack the coils into bytes, first coil into bit 0
+  uint8_t byte = 0;
+  for (uint16_t i = 0; i < coils; i++) {
+    uint16_t bit = addr + i;
+    if (memo[bit >> 4] & (1 << (bit & 0x0F))) byte |= 1 << (i & 0x07);
+    if ((i & 0x07) == 0x07 || i == coils - 1) {
+      response.add(byte);
+      byte = 0;
+    }
+  }
+
+  // Return the data response
+  return response;
+}
+
+// Worker function for block read tests, function code 0x03: every register holds its address.
+// Requests starting at 1000 get an error: ILLEGAL_DATA_ADDRESS below 1100, ILLEGAL_DATA_VALUE above
+ModbusMessage FC03block(ModbusMessage request) {
+  uint16_t addr = 0;        // Start address to read
+  uint16_t wrds = 0;        // Number of words to read
+  ModbusMessage response;
+
+  request.get(2, addr, wrds);
+
+  // Address in the error range?
+  if (addr >= 1000) {
+    // Yes. Return error response
+    response.setError(request.getServerID(), request.getFunctionCode(), addr < 1100 ? ILLEGAL_DATA_ADDRESS : ILLEGAL_DATA_VALUE);
+    return response;
+  }
+
+  response.add(request.getServerID(), request.getFunctionCode(), (uint8_t)(wrds * 2));
+  for (uint16_t i = 0; i < wrds; i++) {
+    response.add((uint16_t)(addr + i));
+  }
+  return response;
+}
+
+// Worker function for block read tests, function code 0x01: every coil with an address divisible by 3 is set
+ModbusMessage FC01block(ModbusMessage request) {
+  uint16_t addr = 0;        // First coil to read
+  uint16_t coils = 0;       // Number of coils to read
+  ModbusMessage response;
+
+  request.get(2, addr, coils);
+
+  response.add(request.getServerID(), request.getFunctionCode(), (uint8_t)((coils + 7) / 8));
+  uint8_t byte = 0;
+  for (uint16_t i = 0; i < coils; i++) {
+    if ((addr + i) % 3 == 0) byte |= 1 << (i & 0x07);
+    if ((i & 0x07) == 0x07 || i == coils - 1) {
+      response.add(byte);
+      byte = 0;
+    }
+  }
+  return response;
+}
+
 // Worker function function code 0x41 (user defined)
 ModbusMessage FC41(const ModbusMessage& request) {
   // return nothing to test timeout
@@ -300,6 +381,15 @@ ModbusMessage makeVector(const char *text) {
   return rv;
 }
 
+// Helper function to build a Modbus TCP frame: MBAP header with the given transactionID, then the PDU
+ModbusMessage makeFrame(uint16_t transactionID, const char *text) {
+  ModbusMessage pdu = makeVector(text);
+  ModbusMessage rv;
+  rv.add(transactionID, (uint16_t)0, (uint16_t)pdu.size());
+  rv.add(pdu.data(), pdu.size());
+  return rv;
+}
+
 // The test functions are named as follows: "MSG" and a 2-digit number denoting the 
 // underlying setMessage() function. The "MSG08()" functions will call setError() instead
 //
@@ -653,6 +743,170 @@ void setup()
   adder.add(b);
   testOutput(__func__, LNO(__LINE__) "add double swapped", makeVector("11 88 45 33 F6 23 C0 CA C0 11"), adder);
 
+  // Write TCP header into headroom and CRC into tailroom
+  ModbusMessage framed(adder.size() + 8);
+  framed.headroom(6);
+  framed = adder;
+  uint8_t *head = framed.headroom(6);
+  memcpy(head, "\x12\x34\x00\x00\x00\x0A", 6);
+  uint8_t *tail = framed.tailroom(2);
+  tail[0] = 0xAB;
+  tail[1] = 0xCD;
+  ModbusMessage frame;
+  frame.add(head, framed.size() + 8);
+  testOutput(__func__, LNO(__LINE__) "headroom/tailroom frame", makeVector("12 34 00 00 00 0A 11 88 45 33 F6 23 C0 CA C0 11 AB CD"), frame);
+  testOutput(__func__, LNO(__LINE__) "headroom/tailroom data", makeVector("11 88 45 33 F6 23 C0 CA C0 11"), framed);
+
+  // Read values through a view on the message data
+  ModbusMessageView view(framed.data() + 1, framed.size() - 2);
+  double dv = 0.0;
+  view.get(0, dv, SWAP_WORDS|SWAP_BYTES);
+  ModbusMessage viewed;
+  viewed.add(dv);
+  ModbusMessage copied(view);
+  viewed.append(copied);
+  testOutput(__func__, LNO(__LINE__) "view get double", makeVector("C0 23 C0 CA 45 88 F6 33 88 45 33 F6 23 C0 CA C0"), viewed);
+
+  // Bulk register arrays
+  uint16_t regs[3] = { 0x1122, 0x3344, 0x5566 };
+  uint32_t dwords[2] = { 0x11223344, 0x55667788 };
+  ModbusMessage bulk;
+  bulk.addRegisters(regs, 3);
+  bulk.addRegisters(dwords, 2, SWAP_REGISTERS);
+  testOutput(__func__, LNO(__LINE__) "addRegisters", makeVector("11 22 33 44 55 66 33 44 11 22 77 88 55 66"), bulk);
+
+  uint16_t regsBack[3] = { 0, 0, 0 };
+  uint32_t dwordsBack[2] = { 0, 0 };
+  uint16_t bulkIndex = bulk.getRegisters(0, regsBack, 3);
+  bulk.getRegisters(bulkIndex, dwordsBack, 2, SWAP_REGISTERS);
+  ModbusMessage bulkBack;
+  bulkBack.add(regsBack[0], regsBack[1], regsBack[2], dwordsBack[0], dwordsBack[1]);
+  testOutput(__func__, LNO(__LINE__) "getRegisters", makeVector("11 22 33 44 55 66 11 22 33 44 55 66 77 88"), bulkBack);
+
+  // Bulk float and double arrays
+  float floats[2] = { f, f };
+  double doubles[2] = { d, d };
+  bulk.clear();
+  bulk.addRegisters(floats, 2, SWAP_REGISTERS|SWAP_NIBBLES);
+  bulk.addRegisters(doubles, 2, SWAP_WORDS|SWAP_BYTES);
+  testOutput(__func__, LNO(__LINE__) "addRegisters float/double", 
+    makeVector("60 15 F3 E9 60 15 F3 E9 88 45 33 F6 23 C0 CA C0 88 45 33 F6 23 C0 CA C0"), bulk);
+
+  float floatsBack[2] = { 0.0, 0.0 };
+  double doublesBack[2] = { 0.0, 0.0 };
+  bulkIndex = bulk.getRegisters(0, floatsBack, 2, SWAP_REGISTERS|SWAP_NIBBLES);
+  bulk.getRegisters(bulkIndex, doublesBack, 2, SWAP_WORDS|SWAP_BYTES);
+  bulkBack.clear();
+  bulkBack.add(floatsBack[0]);
+  bulkBack.add(floatsBack[1]);
+  bulkBack.add(doublesBack[0]);
+  bulkBack.add(doublesBack[1]);
+  testOutput(__func__, LNO(__LINE__) "getRegisters float/double", 
+    makeVector("3F 9E 06 51 3F 9E 06 51 C0 23 C0 CA 45 88 F6 33 C0 23 C0 CA 45 88 F6 33"), bulkBack);
+
+  // Compile time built requests
+  constexpr FixedRequest<6> fixedReq = makeRequest<READ_HOLD_REGISTER>(1, 0x1234, 10);
+  testOutput(__func__, LNO(__LINE__) "makeRequest FC03", makeVector("01 03 12 34 00 0A"), ModbusMessage(fixedReq.view()));
+  FixedRequest<6> badReq = makeRequest<READ_HOLD_REGISTER>(1, 0x1234, dwordsBack[0] & 0x0FFF);
+  ModbusMessage badMsg;
+  badMsg.setError(1, READ_HOLD_REGISTER, badReq.getError());
+  testOutput(__func__, LNO(__LINE__) "makeRequest limit", makeVector("01 83 E7"), badMsg);
+
+  // Message storage: a pattern longer than the inline storage
+  const uint16_t patternLen = MM_INLINE_SIZE + 20;
+  uint8_t pattern[patternLen];
+  for (uint16_t i = 0; i < patternLen; ++i) {
+    pattern[i] = i & 0xFF;
+  }
+  ModbusMessage patternMsg;
+  patternMsg.add(pattern, patternLen);
+  ModbusMessage flags;
+
+  // Growing byte by byte from inline storage to the heap
+  ModbusMessage growing;
+  for (uint16_t i = 0; i < patternLen; ++i) {
+    growing.push_back(pattern[i]);
+  }
+  testOutput(__func__, LNO(__LINE__) "inline to heap", patternMsg, growing);
+
+  // Copy and move of small (inline) and large (heap) messages
+  ModbusMessage small;
+  small.add(pattern, 8);
+  ModbusMessage smallCopy(small);
+  testOutput(__func__, LNO(__LINE__) "copy small", makeVector("00 01 02 03 04 05 06 07"), smallCopy);
+  ModbusMessage largeCopy(patternMsg);
+  testOutput(__func__, LNO(__LINE__) "copy large", patternMsg, largeCopy);
+  ModbusMessage smallMoved(std::move(smallCopy));
+  testOutput(__func__, LNO(__LINE__) "move small", makeVector("00 01 02 03 04 05 06 07"), smallMoved);
+  testOutput(__func__, LNO(__LINE__) "moved small source", empty, smallCopy);
+  ModbusMessage largeMoved(std::move(largeCopy));
+  testOutput(__func__, LNO(__LINE__) "move large", patternMsg, largeMoved);
+  testOutput(__func__, LNO(__LINE__) "moved large source", empty, largeCopy);
+  // Assignments the other way round: large into small and small into large
+  smallMoved = patternMsg;
+  testOutput(__func__, LNO(__LINE__) "assign large to small", patternMsg, smallMoved);
+  largeMoved = std::move(small);
+  testOutput(__func__, LNO(__LINE__) "move assign small to large", makeVector("00 01 02 03 04 05 06 07"), largeMoved);
+  largeMoved = std::move(smallMoved);
+  testOutput(__func__, LNO(__LINE__) "move assign large", patternMsg, largeMoved);
+
+  // Appending a message to itself - the source moves with a reallocation
+  ModbusMessage selfAppended(patternMsg);
+  selfAppended.append(selfAppended);
+  ModbusMessage selfExpected(patternMsg);
+  selfExpected.add(pattern, patternLen);
+  testOutput(__func__, LNO(__LINE__) "self append", selfExpected, selfAppended);
+
+  // Growing headroom: first shifting the data within the storage, then reallocating
+  ModbusMessage headed;
+  headed.add(pattern, 8);
+  uint8_t *hr = headed.headroom(2);
+  hr[0] = 0xAA;
+  hr[1] = 0xBB;
+  hr = headed.headroom(6);
+  memset(hr, 0xCC, 6);
+  ModbusMessage headFrame;
+  headFrame.add(hr, headed.size() + 6);
+  testOutput(__func__, LNO(__LINE__) "headroom grown frame", makeVector("CC CC CC CC CC CC 00 01 02 03 04 05 06 07"), headFrame);
+  testOutput(__func__, LNO(__LINE__) "headroom grown data", makeVector("00 01 02 03 04 05 06 07"), headed);
+  ModbusMessage headedLarge(patternMsg);
+  hr = headedLarge.headroom(6);
+  memset(hr, 0xDD, 6);
+  headFrame.clear();
+  headFrame.add(hr, headedLarge.size() + 6);
+  ModbusMessage headExpected(makeVector("DD DD DD DD DD DD"));
+  headExpected.append(patternMsg);
+  testOutput(__func__, LNO(__LINE__) "headroom large frame", headExpected, headFrame);
+  testOutput(__func__, LNO(__LINE__) "headroom large data", patternMsg, headedLarge);
+
+  // 0xFFFF bytes at most. Anything beyond is refused, not written.
+  uint8_t *block = new uint8_t[40000];
+  memset(block, 0x5A, 40000);
+  ModbusMessage huge;
+  huge.add(block, 40000);
+  huge.add(block, 30000);
+  flags.clear();
+  flags.add(huge.size());
+  huge.add(block, 25535);
+  flags.add(huge.size());
+  huge.push_back(0x01);
+  flags.add(huge.size());
+  flags.add((uint8_t)(huge.headroom(6) == nullptr));
+  flags.add((uint8_t)(huge.tailroom(1) == nullptr));
+  testOutput(__func__, LNO(__LINE__) "size limit", makeVector("9C 40 FF FF FF FF 01 01"), flags);
+  uint16_t limitRegs[4] = { 0x1122, 0x3344, 0x5566, 0x7788 };
+  huge.resize(0xFFFB);
+  huge.addRegisters(limitRegs, 4);
+  flags.clear();
+  flags.add(huge.size());
+  huge.addRegisters(limitRegs, 2);
+  flags.add(huge.size());
+  testOutput(__func__, LNO(__LINE__) "addRegisters limit", makeVector("FF FB FF FF"), flags);
+  delete[] block;
+  std::vector<uint8_t> tooLarge(70000, 0x5A);
+  ModbusMessage fromVector(tooLarge);
+  testOutput(__func__, LNO(__LINE__) "vector too large", empty, fromVector);
+
   // Print summary.
   Serial.printf("----->    Generate messages tests: %4d, passed: %4d\n", testsExecuted, testsPassed);
 
@@ -806,14 +1060,15 @@ void setup()
   delay(5000);
   stub.flush();
 
-  // Send response with wrong transaction ID
+  // Send response with wrong transaction ID. The client drops it as a stray response
+  // and keeps waiting, so the request runs into the 500ms timeout set above
   tc = new TestCase { 
     .name = LNO(__LINE__),
     .testname = "Wrong transaction ID in response",
     .transactionID = static_cast<uint16_t>(TestTCP.getMessageCount() & 0xFFFF),
     .token = Token++,
     .response = makeVector("01 07"),
-    .expected = makeVector("01 87 EB"),
+    .expected = makeVector("01 87 E0"),
     .delayTime = 0,
     .stopAfterResponding = false,
     .fakeTransactionID = true
@@ -829,6 +1084,55 @@ void setup()
   }
   WAIT_FOR_FINISH(TestTCP)
 
+  // A stale response to an earlier transaction arrives ahead of the correct one.
+  // The client has to drop it and take the following response
+  tc = new TestCase { 
+    .name = LNO(__LINE__),
+    .testname = "Stale transaction ID before response",
+    .transactionID = static_cast<uint16_t>(TestTCP.getMessageCount() & 0xFFFF),
+    .token = Token++,
+    .response = makeVector("01 03 02 12 34"),
+    .expected = makeVector("01 03 02 12 34"),
+    .delayTime = 0,
+    .stopAfterResponding = false,
+    .fakeTransactionID = false
+  };
+  tc->lead = makeFrame(tc->transactionID - 1, "01 03 02 00 01");
+  testCasesByTID[tc->transactionID] = tc;
+  testCasesByToken[tc->token] = tc;
+  e = TestTCP.addRequest(tc->token, 1, 0x03, 1, 1);
+  if (e != SUCCESS) {
+    ModbusMessage ri;
+    ri.add(e);
+    testOutput(tc->testname, tc->name, tc->expected, ri);
+    highestTokenProcessed = tc->token;
+  }
+  WAIT_FOR_FINISH(TestTCP)
+
+  // The response arrives in two segments: the MBAP header first, the rest 200ms later
+  tc = new TestCase { 
+    .name = LNO(__LINE__),
+    .testname = "Response split after MBAP header",
+    .transactionID = static_cast<uint16_t>(TestTCP.getMessageCount() & 0xFFFF),
+    .token = Token++,
+    .response = makeVector("01 03 04 11 22 33 44"),
+    .expected = makeVector("01 03 04 11 22 33 44"),
+    .delayTime = 200,
+    .stopAfterResponding = false,
+    .fakeTransactionID = false
+  };
+  tc->splitAt = 6;
+  testCasesByTID[tc->transactionID] = tc;
+  testCasesByToken[tc->token] = tc;
+  e = TestTCP.addRequest(tc->token, 1, 0x03, 1, 2);
+  if (e != SUCCESS) {
+    ModbusMessage ri;
+    ri.add(e);
+    testOutput(tc->testname, tc->name, tc->expected, ri);
+    highestTokenProcessed = tc->token;
+  }
+  WAIT_FOR_FINISH(TestTCP)
+
   // Send response with wrong server ID
   tc = new TestCase { 
     .name = LNO(__LINE__),
@@ -1115,6 +1419,183 @@ void setup()
     highestTokenProcessed = tc->token;
   }
 
+  WAIT_FOR_FINISH(TestTCP)
+
+  // ****************************************************************************************
+  // Pipelining: up to 3 requests are sent before their responses arrive.
+  // The stub answers the third request with the responses to the third and second one,
+  // the first request is left to time out. A late response to it has to be dropped.
+  PipeTCP.onResponseHandler(&handleData);
+  PipeTCP.setMaxInflightRequests(3);
+  PipeTCP.begin();
+  pipeStub.begin(&testCasesByTID, testHost, 502);
+  PipeTCP.setTarget(testHost, 502, 1000, 1);
+
+  uint16_t tidTimedOut = static_cast<uint16_t>(PipeTCP.getMessageCount() & 0xFFFF);
+  uint16_t tidSecond = tidTimedOut + 1;
+  uint16_t tidThird = tidTimedOut + 2;
+  struct {
+    const char *testname;
+    uint16_t address;
+    bool answerAll;
+    const char *expected;
+  } pipeCases[] = {
+    { "Pipelining: timeout in window",    1, false, "01 83 E0" },
+    { "Pipelining: second answered",      2, false, "01 03 02 00 02" },
+    { "Pipelining: third answered first", 3, true,  "01 03 02 00 03" },
+  };
+  for (auto& pc : pipeCases) {
+    tc = new TestCase { 
+      .name = LNO(__LINE__),
+      .testname = pc.testname,
+      .transactionID = static_cast<uint16_t>(PipeTCP.getMessageCount() & 0xFFFF),
+      .token = Token++,
+      .response = empty,
+      .expected = makeVector(pc.expected),
+      .delayTime = 0,
+      .stopAfterResponding = false,
+      .fakeTransactionID = false
+    };
+    // Out of order: the responses to the third and second request in one go
+    if (pc.answerAll) {
+      ModbusMessage second = makeFrame(tidSecond, "01 03 02 00 02");
+      tc->lead = makeFrame(tidThird, "01 03 02 00 03");
+      tc->lead.append(second);
+    }
+    testCasesByTID[tc->transactionID] = tc;
+    testCasesByToken[tc->token] = tc;
+    e = PipeTCP.addRequest(tc->token, 1, READ_HOLD_REGISTER, pc.address, 1);
+    if (e != SUCCESS) {
+      ModbusMessage ri;
+      ri.add(e);
+      testOutput(tc->testname, tc->name, tc->expected, ri);
+      highestTokenProcessed = tc->token;
+    }
+  }
+  // The highest token is answered before the first request times out - wait for all of them
+  while (PipeTCP.pendingRequests()) delay(100);
+
+  // The late response to the first request arrives ahead of the one to the next request
+  tc = new TestCase { 
+    .name = LNO(__LINE__),
+    .testname = "Pipelining: late response dropped",
+    .transactionID = static_cast<uint16_t>(PipeTCP.getMessageCount() & 0xFFFF),
+    .token = Token++,
+    .response = makeVector("01 03 02 00 04"),
+    .expected = makeVector("01 03 02 00 04"),
+    .delayTime = 0,
+    .stopAfterResponding = false,
+    .fakeTransactionID = false
+  };
+  tc->lead = makeFrame(tidTimedOut, "01 03 02 00 01");
+  testCasesByTID[tc->transactionID] = tc;
+  testCasesByToken[tc->token] = tc;
+  e = PipeTCP.addRequest(tc->token, 1, READ_HOLD_REGISTER, 4, 1);
+  if (e != SUCCESS) {
+    ModbusMessage ri;
+    ri.add(e);
+    testOutput(tc->testname, tc->name, tc->expected, ri);
+    highestTokenProcessed = tc->token;
+  }
+  WAIT_FOR_FINISH(PipeTCP)
+
+  // Two responses arrive in one segment. The stub keeps quiet on the first request
+  // and answers both with the second one
+  uint16_t tidFirst = static_cast<uint16_t>(PipeTCP.getMessageCount() & 0xFFFF);
+  const char *bothNames[] = { "Two responses in one segment - 1", "Two responses in one segment - 2" };
+  for (uint16_t i = 0; i < 2; ++i) {
+    tc = new TestCase { 
+      .name = LNO(__LINE__),
+      .testname = bothNames[i],
+      .transactionID = static_cast<uint16_t>(PipeTCP.getMessageCount() & 0xFFFF),
+      .token = Token++,
+      .response = empty,
+      .expected = makeVector(i ? "01 03 02 00 06" : "01 03 02 00 05"),
+      .delayTime = 0,
+      .stopAfterResponding = false,
+      .fakeTransactionID = false
+    };
+    if (i) {
+      ModbusMessage second = makeFrame(tc->transactionID, "01 03 02 00 06");
+      tc->lead = makeFrame(tidFirst, "01 03 02 00 05");
+      tc->lead.append(second);
+    }
+    testCasesByTID[tc->transactionID] = tc;
+    testCasesByToken[tc->token] = tc;
+    e = PipeTCP.addRequest(tc->token, 1, READ_HOLD_REGISTER, 5 + i, 1);
+    if (e != SUCCESS) {
+      ModbusMessage ri;
+      ri.add(e);
+      testOutput(tc->testname, tc->name, tc->expected, ri);
+      highestTokenProcessed = tc->token;
+    }
+  }
+  WAIT_FOR_FINISH(PipeTCP)
+
+  // ****************************************************************************************
+  // Connection pool: two stub Clients without identity take any target.
+  // Alternating requests to two targets shall reuse the connections, a third target
+  // shall take over the least recently used one, idle connections shall be closed.
+  PoolTCP.onResponseHandler(&handleData);
+  PoolTCP.addClient(poolStubB);
+  PoolTCP.begin();
+  poolStubA.begin(&testCasesByTID);
+  poolStubB.begin(&testCasesByTID);
+  struct {
+    const char *testname;
+    IPAddress host;
+    uint16_t port;
+  } poolCases[] = {
+    { "Pool: target 1",              testHost,  502 },
+    { "Pool: target 2",              testHost2, 502 },
+    { "Pool: target 1 again",        testHost,  502 },
+    { "Pool: target 2 again",        testHost2, 502 },
+    { "Pool: target 3 evicts LRU",   testHost,  503 },
+    { "Pool: target 2 still open",   testHost2, 502 },
+  };
+  ModbusMessage connects;
+  for (uint16_t i = 0; i < sizeof(poolCases) / sizeof(poolCases[0]); ++i) {
+    auto& pc = poolCases[i];
+    ModbusMessage answer;
+    answer.add((uint8_t)1, (uint8_t)READ_HOLD_REGISTER, (uint8_t)2, i);
+    tc = new TestCase { 
+      .name = LNO(__LINE__),
+      .testname = pc.testname,
+      .transactionID = static_cast<uint16_t>(PoolTCP.getMessageCount() & 0xFFFF),
+      .token = Token++,
+      .response = answer,
+      .expected = answer,
+      .delayTime = 0,
+      .stopAfterResponding = false,
+      .fakeTransactionID = false
+    };
+    testCasesByTID[tc->transactionID] = tc;
+    testCasesByToken[tc->token] = tc;
+    PoolTCP.setTarget(pc.host, pc.port, 1000, 1);
+    e = PoolTCP.addRequest(tc->token, 1, READ_HOLD_REGISTER, i + 1, 1);
+    if (e != SUCCESS) {
+      ModbusMessage ri;
+      ri.add(e);
+      testOutput(tc->testname, tc->name, tc->expected, ri);
+      highestTokenProcessed = tc->token;
+    }
+    WAIT_FOR_FINISH(PoolTCP)
+    // Note the connects after the alternating requests and after the eviction
+    if (i == 3 || i == 5) {
+      connects.add((uint8_t)poolStubA.connectCount(), (uint8_t)poolStubB.connectCount());
+    }
+  }
+  // Target 1 and 2 connected once each, target 3 took over the connection to target 1
+  testOutput("Connection pool", LNO(__LINE__) "connects", makeVector("01 01 02 01"), connects);
+
+  // Both connections are closed after the idle timeout
+  PoolTCP.setIdleTimeout(500);
+  delay(1500);
+  connects.clear();
+  connects.add(poolStubA.connected(), poolStubB.connected());
+  testOutput("Connection pool", LNO(__LINE__) "idle timeout", makeVector("00 00"), connects);
+  PoolTCP.setIdleTimeout(0);
+
   // Print summary. We will have to wait a bit to get all test cases executed!
   WAIT_FOR_FINISH(TestTCP)
 
@@ -1200,6 +1681,7 @@ void setup()
     RTUserver.registerWorker(1, READ_HOLD_REGISTER, &FC03);      // FC=03 for serverID=1
     RTUserver.registerWorker(1, READ_INPUT_REGISTER, &FC03);     // FC=04 for serverID=1
     RTUserver.registerWorker(1, WRITE_HOLD_REGISTER, &FC06);     // FC=06 for serverID=1
+    RTUserver.registerWorker(1, READ_COIL, &FC01);               // FC=01 for serverID=1
     RTUserver.registerWorker(1, USER_DEFINED_44, &FC44);         // FC=44 for serverID=1
     RTUserver.registerWorker(1, USER_DEFINED_45, &FC45);         // FC=45 for serverID=1
     RTUserver.registerWorker(2, READ_HOLD_REGISTER, &FC03);      // FC=03 for serverID=2
@@ -1506,6 +1988,233 @@ void setup()
 
     WAIT_FOR_FINISH(RTUclient)
 
+    // Coalescing queued reads
+    RTUclient.coalesceReads(true);
+
+    // A request nobody answers keeps the bus busy until all of the below are queued
+    tc = new TestCase { 
+      .name = LNO(__LINE__),
+      .testname = "Coalesce: hold the bus",
+      .transactionID = 0,
+      .token = Token++,
+      .response = empty,
+      .expected = makeVector("E0"), 
+      .delayTime = 0,
+      .stopAfterResponding = true,
+      .fakeTransactionID = false
+    };
+    testCasesByToken[tc->token] = tc;
+    e = RTUclient.addRequest(tc->token, 2, USER_DEFINED_41);
+    if (e != SUCCESS) {
+      ModbusMessage ri;
+      ri.add(e);
+      testOutput(tc->testname, tc->name, tc->expected, ri);
+      highestTokenProcessed = tc->token;
+    }
+
+    struct {
+      const char *testname;
+      uint8_t functionCode;
+      uint16_t p1;
+      uint16_t p2;
+      const char *expected;
+    } coalesceCases[] = {
+      // Adjacent and overlapping register reads - one request for registers 2..6
+      { "Coalesce: first read",           READ_HOLD_REGISTER,   2,      3, "01 03 06 02 03 04 05 06 07" },
+      { "Coalesce: adjacent read",        READ_HOLD_REGISTER,   5,      2, "01 03 04 08 09 0A 0B" },
+      { "Coalesce: overlapping read",     READ_HOLD_REGISTER,   3,      4, "01 03 08 04 05 06 07 08 09 0A 0B" },
+      // Too far away to be merged
+      { "Coalesce: read behind gap",      READ_HOLD_REGISTER,  19,      1, "01 03 02 24 25" },
+      // Coils 163..180, cut at bit offsets not aligned to bytes
+      { "Coalesce: coils 163..167",       READ_COIL,          163,      5, "01 01 01 02" },
+      { "Coalesce: coils 168..177",       READ_COIL,          168,     10, "01 01 02 14 03" },
+      { "Coalesce: coils 178..180",       READ_COIL,          178,      3, "01 01 01 05" },
+      // The write ends the merge: the read behind it must not join register 19 and has to get the new value
+      { "Coalesce: write stops merge",    WRITE_HOLD_REGISTER, 20, 0x1234, "01 06 00 14 12 34" },
+      { "Coalesce: read after write",     READ_HOLD_REGISTER,  20,      1, "01 03 02 12 34" },
+    };
+    for (auto& cc : coalesceCases) {
+      tc = new TestCase { 
+        .name = LNO(__LINE__),
+        .testname = cc.testname,
+        .transactionID = 0,
+        .token = Token++,
+        .response = empty,
+        .expected = makeVector(cc.expected),
+        .delayTime = 0,
+        .stopAfterResponding = true,
+        .fakeTransactionID = false
+      };
+      testCasesByToken[tc->token] = tc;
+      e = RTUclient.addRequest(tc->token, 1, cc.functionCode, cc.p1, cc.p2);
+      if (e != SUCCESS) {
+        ModbusMessage ri;
+        ri.add(e);
+        testOutput(tc->testname, tc->name, tc->expected, ri);
+        highestTokenProcessed = tc->token;
+      }
+    }
+    // 5 responses on the bus: registers 2..6, register 19, coils 163..180, the write and register 20
+    ExpectedToggles += 5;
+
+    WAIT_FOR_FINISH(RTUclient)
+    RTUclient.coalesceReads(false);
+
+    // clearQueue() drops what is queued at the call, but not requests added after it
+    tc = new TestCase { 
+      .name = LNO(__LINE__),
+      .testname = "Clear: hold the bus",
+      .transactionID = 0,
+      .token = Token++,
+      .response = empty,
+      .expected = makeVector("E0"), 
+      .delayTime = 0,
+      .stopAfterResponding = true,
+      .fakeTransactionID = false
+    };
+    testCasesByToken[tc->token] = tc;
+    e = RTUclient.addRequest(tc->token, 2, USER_DEFINED_41);
+    if (e != SUCCESS) {
+      ModbusMessage ri;
+      ri.add(e);
+      testOutput(tc->testname, tc->name, tc->expected, ri);
+      highestTokenProcessed = tc->token;
+    }
+    // Let the worker take the request on the bus before the queue is cleared
+    delay(100);
+
+    // This one is cleared - any response to it is an error
+    tc = new TestCase { 
+      .name = LNO(__LINE__),
+      .testname = "Clear: cleared request answered",
+      .transactionID = 0,
+      .token = Token++,
+      .response = empty,
+      .expected = empty, 
+      .delayTime = 0,
+      .stopAfterResponding = true,
+      .fakeTransactionID = false
+    };
+    testCasesByToken[tc->token] = tc;
+    RTUclient.addRequest(tc->token, 1, READ_HOLD_REGISTER, 2, 1);
+    RTUclient.clearQueue();
+
+    // Added after clearQueue() - has to be processed
+    tc = new TestCase { 
+      .name = LNO(__LINE__),
+      .testname = "Clear: request added after clearQueue()",
+      .transactionID = 0,
+      .token = Token++,
+      .response = empty,
+      .expected = makeVector("01 03 02 02 03"), 
+      .delayTime = 0,
+      .stopAfterResponding = true,
+      .fakeTransactionID = false
+    };
+    testCasesByToken[tc->token] = tc;
+    e = RTUclient.addRequest(tc->token, 1, READ_HOLD_REGISTER, 2, 1);
+    if (e != SUCCESS) {
+      ModbusMessage ri;
+      ri.add(e);
+      testOutput(tc->testname, tc->name, tc->expected, ri);
+      highestTokenProcessed = tc->token;
+    }
+    ExpectedToggles += 1;
+
+    WAIT_FOR_FINISH(RTUclient)
+
+    // Block reads, split into requests of 125 registers or 2000 coils
+    RTUserver.registerWorker(9, READ_HOLD_REGISTER, &FC03block);
+    RTUserver.registerWorker(9, READ_COIL, &FC01block);
+    std::vector<uint8_t> blockData;
+    ModbusMessage blockExpected;
+    ModbusMessage blockResult;
+
+    // 300 registers: 125 + 125 + 50
+    e = RTUclient.readBlock(9, READ_HOLD_REGISTER, 10, 300, blockData);
+    ExpectedToggles += 3;
+    blockExpected.clear();
+    for (uint16_t i = 10; i < 310; ++i) {
+      blockExpected.add(i);
+    }
+    blockResult = ModbusMessage(blockData);
+    if (e != SUCCESS) {
+      blockResult.clear();
+      blockResult.add(e);
+    }
+    testOutput("readBlock", LNO(__LINE__) "300 registers", blockExpected, blockResult);
+
+    // 4500 coils: 2000 + 2000 + 500
+    e = RTUclient.readBlock(9, READ_COIL, 5, 4500, blockData);
+    ExpectedToggles += 3;
+    blockExpected.clear();
+    uint8_t coilByte = 0;
+    for (uint16_t i = 0; i < 4500; ++i) {
+      if ((5 + i) % 3 == 0) coilByte |= 1 << (i & 0x07);
+      if ((i & 0x07) == 0x07 || i == 4499) {
+        blockExpected.add(coilByte);
+        coilByte = 0;
+      }
+    }
+    blockResult = ModbusMessage(blockData);
+    if (e != SUCCESS) {
+      blockResult.clear();
+      blockResult.add(e);
+    }
+    testOutput("readBlock", LNO(__LINE__) "4500 coils", blockExpected, blockResult);
+
+    // Requests 2 and 3 fail with different errors - the first one is reported, no data
+    e = RTUclient.readBlock(9, READ_HOLD_REGISTER, 900, 300, blockData);
+    ExpectedToggles += 3;
+    blockResult.clear();
+    blockResult.add(e, (uint16_t)blockData.size());
+    testOutput("readBlock", LNO(__LINE__) "first error wins", makeVector("02 00 00"), blockResult);
+
+    // Invalid calls are refused right away
+    blockResult.clear();
+    blockResult.add(RTUclient.readBlock(9, WRITE_HOLD_REGISTER, 10, 10, blockData));
+    blockResult.add(RTUclient.readBlock(9, READ_HOLD_REGISTER, 10, 0, blockData));
+    blockResult.add(RTUclient.readBlock(9, READ_HOLD_REGISTER, 0xFFF0, 17, blockData));
+    testOutput("readBlock", LNO(__LINE__) "invalid calls", makeVector("01 E7 E7"), blockResult);
+
+    // A block read dropped by clearQueue() is finished with a TIMEOUT
+    tc = new TestCase { 
+      .name = LNO(__LINE__),
+      .testname = "readBlock: hold the bus",
+      .transactionID = 0,
+      .token = Token++,
+      .response = empty,
+      .expected = makeVector("E0"), 
+      .delayTime = 0,
+      .stopAfterResponding = true,
+      .fakeTransactionID = false
+    };
+    testCasesByToken[tc->token] = tc;
+    e = RTUclient.addRequest(tc->token, 2, USER_DEFINED_41);
+    if (e != SUCCESS) {
+      ModbusMessage ri;
+      ri.add(e);
+      testOutput(tc->testname, tc->name, tc->expected, ri);
+      highestTokenProcessed = tc->token;
+    }
+    // Let the worker take the request on the bus before the queue is cleared
+    delay(100);
+    std::atomic<bool> blockDone(false);
+    blockResult.clear();
+    e = RTUclient.readBlock(9, READ_HOLD_REGISTER, 10, 300, [&](Error err, const std::vector<uint8_t>& d) {
+      blockResult.add(err, (uint16_t)d.size());
+      blockDone = true;
+    });
+    RTUclient.clearQueue();
+    for (uint16_t i = 0; i < 100 && !blockDone; ++i) {
+      delay(100);
+    }
+    blockResult.add(e);
+    testOutput("readBlock", LNO(__LINE__) "dropped by clearQueue()", makeVector("E0 00 00 00"), blockResult);
+
+    // Server 9 has to be unknown for the bridge tests
+    RTUserver.unregisterWorker(9);
+
     // Check RTS toggle
     testsExecuted++;
     // We expect one more LOW callback (initialization)
@@ -2024,6 +2733,10 @@ void setup()
 
     n = RTUclient.syncRequest(Token++, 8, READ_HOLD_REGISTER, 8, 4);
     testOutput("Sync request wrong serverID (RTU)", LNO(__LINE__), makeVector("08 83 E0"), n);
+
+    PreparedRequest pr = RTUclient.prepareRequest(1, READ_HOLD_REGISTER, 1, 4);
+    n = RTUclient.syncRequest(pr, Token++);
+    testOutput("Sync prepared request (RTU)", LNO(__LINE__), makeVector("01 03 08 00 01 02 03 04 05 06 07"), n);
   }
 
   n = TestClientWiFi.syncRequest(Token, 1, READ_HOLD_REGISTER, 4, 4);
@@ -2039,6 +2752,14 @@ void setup()
   n = TestClientWiFi.syncRequest(Token++, 2, READ_HOLD_REGISTER, 32, 160);
   testOutput("Sync request address/words invalid (WiFi)", LNO(__LINE__), makeVector("02 83 E7"), n);
 
+  PreparedRequest prepared = TestClientWiFi.prepareRequest(1, READ_HOLD_REGISTER, 8, 4);
+  n = TestClientWiFi.syncRequest(prepared, Token++);
+  testOutput("Sync prepared request (WiFi)", LNO(__LINE__), makeVector("01 03 08 0E 0F 10 11 12 13 14 15"), n);
+
+  prepared = TestClientWiFi.prepareRequest(2, READ_HOLD_REGISTER, 32, 160);
+  n = TestClientWiFi.syncRequest(prepared, Token++);
+  testOutput("Sync prepared request invalid (WiFi)", LNO(__LINE__), makeVector("02 83 E7"), n);
+
   // Print summary.
   Serial.printf("----->    Synchronous request tests: %4d, passed: %4d\n", testsExecuted, testsPassed);
 
@@ -0,0 +1,87 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to ModbusClient
+//               MIT license - see license.md for details
+// =================================================================================================
+
+// Example code to show the usage of the eModbus library.
+// Please refer to root/Readme.md for a full description.
+
+// Benchmark of RTUutils::calcCRC() against the byte-wise two table CRC16 used before.
+
+// Includes: <Arduino.h> for Serial etc.
+#include <Arduino.h>
+
+// Include the header for the RTU utilities
+#include "ModbusMessage.h"
+#include "RTUutils.h"
+
+// Number of CRC calculations per frame size
+#define ROUNDS 10000
+
+// Byte-wise reference tables, filled in setup()
+uint8_t crcHiTable[256];
+uint8_t crcLoTable[256];
+
+// Byte-wise reference CRC16 calculation
+uint16_t byteWiseCRC(const uint8_t *data, uint16_t len) {
+  uint8_t crcHi = 0xFF;
+  uint8_t crcLo = 0xFF;
+
+  while (len--) {
+    uint8_t index = crcLo ^ *data++;
+    crcLo = crcHi ^ crcHiTable[index];
+    crcHi = crcLoTable[index];
+  }
+  return (crcHi << 8 | crcLo);
+}
+
+// Frame data to run the CRC over
+uint8_t frame[256];
+
+// Setup() - initialization happens here
+void setup() {
+// Init Serial monitor
+  Serial.begin(115200);
+  while (!Serial) {}
+  Serial.println("__ OK __");
+
+// Build the reference tables
+  for (uint16_t i = 0; i < 256; ++i) {
+    uint16_t crc = i;
+    for (uint8_t bit = 0; bit < 8; ++bit) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+    crcHiTable[i] = crc & 0xFF;
+    crcLoTable[i] = crc >> 8;
+  }
+
+// Fill the frame with some data
+  for (uint16_t i = 0; i < sizeof(frame); ++i) {
+    frame[i] = random(256);
+  }
+
+// Run both variants on typical frame sizes
+  const uint16_t sizes[] = { 8, 16, 64, 128, 256 };
+  for (auto len : sizes) {
+    volatile uint16_t sink = 0;
+
+    uint32_t start = micros();
+    for (uint32_t i = 0; i < ROUNDS; ++i) {
+      sink ^= byteWiseCRC(frame, len);
+    }
+    uint32_t byteWise = micros() - start;
+
+    start = micros();
+    for (uint32_t i = 0; i < ROUNDS; ++i) {
+      sink ^= RTUutils::calcCRC(frame, len);
+    }
+    uint32_t calcCRC = micros() - start;
+
+    Serial.printf("%3d bytes: byte-wise %6u us, calcCRC %6u us, %s\n", len, byteWise, calcCRC,
+      byteWiseCRC(frame, len) == RTUutils::calcCRC(frame, len) ? "same result" : "RESULTS DIFFER!");
+  }
+}
+
+void loop() {
+  delay(10000);
+}
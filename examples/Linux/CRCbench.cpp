@@ -0,0 +1,78 @@
+#include "Logging.h"
+#include "ModbusMessage.h"
+#include "RTUutils.h"
+#include <stdlib.h>
+#include <chrono>                   // NOLINT
+
+// Byte-wise reference tables, as used before slicing-by-8
+uint8_t crcHiTable[256];
+uint8_t crcLoTable[256];
+
+// Byte-wise reference CRC16 calculation
+uint16_t byteWiseCRC(const uint8_t *data, uint16_t len) {
+  uint8_t crcHi = 0xFF;
+  uint8_t crcLo = 0xFF;
+
+  while (len--) {
+    uint8_t index = crcLo ^ *data++;
+    crcLo = crcHi ^ crcHiTable[index];
+    crcHi = crcLoTable[index];
+  }
+  return (crcHi << 8 | crcLo);
+}
+
+// Run a CRC function <rounds> times over the frame and return the time taken in ns
+using CRCfunction = uint16_t (*)(const uint8_t *data, uint16_t len);
+uint64_t timeCRC(CRCfunction crc, const uint8_t *frame, uint16_t len, uint32_t rounds) {
+  volatile uint16_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < rounds; ++i) {
+    sink ^= crc(frame, len);
+  }
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ============= main =============
+int main(int argc, char **argv) {
+  uint32_t rounds = 100000;
+
+  if (argc > 1) rounds = atoi(argv[1]);
+  if (!rounds) {
+    printf("Usage: %s [rounds]\n", argv[0]);
+    return -1;
+  }
+
+  // Build the reference tables
+  for (uint16_t i = 0; i < 256; ++i) {
+    uint16_t crc = i;
+    for (uint8_t bit = 0; bit < 8; ++bit) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+    crcHiTable[i] = crc & 0xFF;
+    crcLoTable[i] = crc >> 8;
+  }
+
+  // Fill the frame with some data
+  uint8_t frame[256];
+  srandom(4711);
+  for (uint16_t i = 0; i < sizeof(frame); ++i) {
+    frame[i] = random() & 0xFF;
+  }
+
+  // Run both variants on typical frame sizes
+  printf("%u rounds per frame size, ns per CRC\n", rounds);
+  printf("bytes  byte-wise  slicing-by-8  speedup\n");
+  int differ = 0;
+  const uint16_t sizes[] = { 8, 16, 64, 128, 256 };
+  for (auto len : sizes) {
+    uint64_t byteWise = timeCRC(byteWiseCRC, frame, len, rounds);
+    uint64_t sliced = timeCRC(RTUutils::calcCRC, frame, len, rounds);
+    bool same = byteWiseCRC(frame, len) == RTUutils::calcCRC(frame, len);
+    if (!same) differ++;
+
+    printf("%5u  %9.1f  %12.1f  %6.2fx%s\n", len, (double)byteWise / rounds, (double)sliced / rounds,
+      sliced ? (double)byteWise / sliced : 0.0, same ? "" : "  RESULTS DIFFER!");
+  }
+
+  return differ ? 1 : 0;
+}
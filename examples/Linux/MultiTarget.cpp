@@ -0,0 +1,90 @@
+#include "Logging.h"
+#include "ModbusClientTCPepoll.h"
+#include "parseTarget.h"
+#include <stdlib.h>
+#include <atomic>
+#include <vector>
+
+// Count the responses coming in
+std::atomic<uint32_t> good(0);
+std::atomic<uint32_t> bad(0);
+
+// ============= main =============
+int main(int argc, char **argv) {
+  uint32_t rounds = 100;
+  uint32_t window = 1;
+  uint16_t addr = 1;
+  uint16_t words = 8;
+
+  if (argc < 4) {
+    printf("Usage: %s rounds window target [target ...]\n", argv[0]);
+    printf("  Reads %u registers from each target <rounds> times, with up to <window> requests in flight per target.\n", words);
+    printf("  A target is IP[:port[:serverID]] or hostname[:port[:serverID]]. IP:port-port:serverID will add a range of ports.\n");
+    return -1;
+  }
+  rounds = atoi(argv[1]);
+  window = atoi(argv[2]);
+
+  // Collect the targets
+  struct Target {
+    IPAddress ip;
+    uint16_t port;
+    uint8_t serverID;
+  };
+  std::vector<Target> targets;
+  for (int i = 3; i < argc; ++i) {
+    char buf[64];
+    uint16_t lastPort = 0;
+    // Port range given?
+    snprintf(buf, sizeof(buf), "%s", argv[i]);
+    char *colon = strchr(buf, ':');
+    char *dash = colon ? strchr(colon, '-') : nullptr;
+    if (dash) {
+      lastPort = atoi(dash + 1) & 0xFFFF;
+      char *sid = strchr(dash, ':');
+      if (sid) memmove(dash, sid, strlen(sid) + 1);
+      else     *dash = 0;
+    }
+    Target t = { NIL_ADDR, 502, 1 };
+    if (parseTarget(buf, t.ip, t.port, t.serverID)) {
+      printf("Invalid target descriptor '%s'.\n", argv[i]);
+      return -1;
+    }
+    do {
+      targets.push_back(t);
+    } while (t.port++ < lastPort);
+  }
+
+  // One client and one thread for all targets
+  ModbusClientTCPepoll MBclient(10000);
+  MBclient.onDataHandler([](ModbusMessageView msg, uint32_t token) { good++; });
+  MBclient.onErrorHandler([](Error err, uint32_t token) {
+    ModbusError me(err);
+    if (!bad++) printf("First error: %s (%02X) for target #%u\n", (const char *)me, err, token);
+  });
+  MBclient.setTimeout(2000);
+  MBclient.setMaxInflightRequests(window);
+  MBclient.begin();
+
+  printf("Polling %u targets %u times each, window %u\n", (uint32_t)targets.size(), rounds, window);
+
+  ModbusMessage request;
+  unsigned long start = millis();
+  uint32_t total = rounds * targets.size();
+  for (uint32_t r = 0; r < rounds; ++r) {
+    for (uint32_t t = 0; t < targets.size(); ++t) {
+      request.setMessage(targets[t].serverID, READ_HOLD_REGISTER, addr, words);
+      // Wait for room in the queue
+      while (MBclient.addRequest(request, t, targets[t].ip, targets[t].port) == REQUEST_QUEUE_FULL) delay(1);
+    }
+  }
+  // Wait for all responses
+  while (good + bad < total) delay(1);
+  unsigned long duration = millis() - start;
+
+  printf("%u responses, %u errors in %lu ms: %.0f req/s, %u connections open\n",
+    (uint32_t)good, (uint32_t)bad, duration, total * 1000.0 / (duration ? duration : 1), MBclient.openConnections());
+  MBclient.end();
+
+  return 0;
+}
@@ -0,0 +1,152 @@
+#include "Logging.h"
+#include "ModbusClientRTU.h"
+#include "ModbusServerRTU.h"
+#include "RTUbus.h"
+#include <unistd.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <mutex>                    // NOLINT
+#include <condition_variable>       // NOLINT
+
+// Worker for the servers: return <words> registers counting up from <addr>
+ModbusMessage FC03(ModbusMessage request) {
+  uint16_t addr = 0;
+  uint16_t words = 0;
+  ModbusMessage response;
+
+  request.get(2, addr);
+  request.get(4, words);
+
+  if (words == 0 || words > 125) {
+    response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_VALUE);
+  } else {
+    response.add(request.getServerID(), request.getFunctionCode(), (uint8_t)(words * 2));
+    for (uint16_t i = 0; i < words; ++i) {
+      response.add((uint16_t)(addr + i));
+    }
+  }
+  return response;
+}
+
+// Response hand-over from the client's worker to main()
+std::mutex respLock;
+std::condition_variable respSignal;
+uint32_t respToken = 0;
+bool respError = false;
+
+// ============= main =============
+int main(int argc, char **argv) {
+  uint32_t baudRate = 19200;
+  uint32_t requests = 500;
+  uint8_t servers = 4;
+  uint32_t responseDelay = 0;
+  uint32_t turnaround = 0;
+  uint32_t interval = 0;
+  uint16_t words = 10;
+  bool ascii = false;
+  bool leadingZero = false;
+  bool predict = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "b:n:s:d:t:i:w:azp")) != -1) {
+    switch (opt) {
+    case 'b': baudRate = atoi(optarg); break;
+    case 'n': requests = atoi(optarg); break;
+    case 's': servers = atoi(optarg); break;
+    case 'd': responseDelay = atoi(optarg); break;
+    case 't': turnaround = atoi(optarg); break;
+    case 'i': interval = atoi(optarg); break;
+    case 'w': words = atoi(optarg); break;
+    case 'a': ascii = true; break;
+    case 'z': leadingZero = true; break;
+    case 'p': predict = true; break;
+    default:
+      printf("Usage: %s [-b baudrate] [-n requests] [-s servers] [-d responseDelay_us] [-t turnaround_us]\n", argv[0]);
+      printf("          [-i interval_us] [-w words] [-a (ASCII)] [-z (leading 0x00)] [-p (predict length)]\n");
+      return -1;
+    }
+  }
+  if (servers < 1 || servers > 247 || !requests) {
+    printf("Need 1..247 servers and at least one request\n");
+    return -1;
+  }
+
+  RTUbus bus(baudRate);
+
+  // Set up the servers with IDs 1..servers
+  std::vector<ModbusServerRTU *> srv;
+  for (uint8_t id = 1; id <= servers; ++id) {
+    RTUbus::Port& port = bus.attach();
+    port.setResponseDelay(responseDelay);
+    port.setTurnaround(turnaround);
+    port.setLeadingZero(leadingZero);
+    ModbusServerRTU *s = new ModbusServerRTU(2000);
+    s->registerWorker(id, READ_HOLD_REGISTER, &FC03);
+    if (ascii) s->useModbusASCII();
+    s->skipLeading0x00(leadingZero);
+    s->begin(port, baudRate, -1, interval);
+    srv.push_back(s);
+  }
+
+  // Set up the client
+  RTUbus::Port& clientPort = bus.attach();
+  clientPort.setTurnaround(turnaround);
+  ModbusClientRTU client;
+  client.onResponseHandler([](ModbusMessage response, uint32_t token) {
+    std::lock_guard<std::mutex> lockGuard(respLock);
+    respToken = token;
+    respError = response.getError() != SUCCESS;
+    respSignal.notify_one();
+  });
+  if (ascii) client.useModbusASCII(2000);
+  client.skipLeading0x00(leadingZero);
+  client.predictFrameLength(predict);
+  client.begin(clientPort, baudRate, -1, interval);
+  // Give the workers time to start, the client's is waiting 100ms before it begins
+  delay(200);
+
+  printf("%u requests for %u words to %u servers at %u baud, %s%s%s\n", requests, words, servers, baudRate,
+    ascii ? "ASCII" : "RTU", leadingZero ? ", leading 0x00" : "", predict ? ", predicted length" : "");
+  printf("Response delay %uus, turnaround %uus, interval %uus\n", responseDelay, turnaround, interval);
+
+  // Run the requests one after the other, round robin over the servers
+  std::vector<uint32_t> latency;
+  uint32_t errors = 0;
+  latency.reserve(requests);
+  bus.resetStatistics();
+  uint64_t begin = RTUbus::now();
+  for (uint32_t i = 1; i <= requests; ++i) {
+    uint64_t start = RTUbus::now();
+    Error err = client.addRequest(i, (uint8_t)((i - 1) % servers + 1), READ_HOLD_REGISTER, (uint16_t)i, words);
+    if (err != SUCCESS) {
+      errors++;
+      continue;
+    }
+    std::unique_lock<std::mutex> lockGuard(respLock);
+    respSignal.wait(lockGuard, [i] { return respToken == i; });
+    latency.push_back(RTUbus::now() - start);
+    if (respError) errors++;
+  }
+  uint64_t elapsed = RTUbus::now() - begin;
+
+  client.end();
+  for (auto s : srv) {
+    s->end();
+    delete s;
+  }
+
+  // Report
+  std::sort(latency.begin(), latency.end());
+  uint64_t sum = 0;
+  for (auto l : latency) sum += l;
+  printf("%.1f requests/s, %u errors, %u collisions, %u bytes on the bus\n",
+    requests * 1000000.0 / elapsed, errors, bus.collisions(), bus.bytesSent());
+  if (!latency.empty()) {
+    printf("Latency us: min %u, avg %u, 50%% %u, 99%% %u, max %u\n",
+      latency.front(), (uint32_t)(sum / latency.size()), latency[latency.size() / 2],
+      latency[latency.size() * 99 / 100], latency.back());
+  }
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,83 @@
+#include "Logging.h"
+#include "ModbusClientRTU.h"
+#include "ModbusServerRTU.h"
+#include "SerialPort.h"
+#include <fcntl.h>
+#include <stdlib.h>
+
+// Worker for the server: return <words> registers counting up from <addr>
+ModbusMessage FC03(ModbusMessage request) {
+  uint16_t addr = 0;
+  uint16_t words = 0;
+  ModbusMessage response;
+
+  request.get(2, addr);
+  request.get(4, words);
+
+  if (words == 0 || words > 125) {
+    response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_VALUE);
+  } else {
+    response.add(request.getServerID(), request.getFunctionCode(), (uint8_t)(words * 2));
+    for (uint16_t i = 0; i < words; ++i) {
+      response.add((uint16_t)(addr + i));
+    }
+  }
+  return response;
+}
+
+// ============= main =============
+int main(int argc, char **argv) {
+  uint32_t baudRate = 19200;
+  uint16_t addr = 1;
+  uint16_t words = 8;
+
+  if (argc > 4) {
+    printf("Usage: %s [baudrate [address [numRegisters]]]\n", argv[0]);
+    return -1;
+  }
+  if (argc > 1) baudRate = atoi(argv[1]);
+  if (argc > 2) addr = atoi(argv[2]) & 0xFFFF;
+  if (argc > 3) words = atoi(argv[3]) & 0xFFFF;
+
+  // Open a pseudo terminal pair. The server will use the master side, the client the slave side.
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) || unlockpt(master)) {
+    printf("Could not open a pseudo terminal\n");
+    return -1;
+  }
+
+  SerialPort serverPort;
+  SerialPort clientPort;
+  const char *slave = ptsname(master);
+  if (!clientPort.begin(slave, baudRate) || !serverPort.begin(master, baudRate)) {
+    printf("Could not set up %s at %u baud\n", slave, baudRate);
+    return -1;
+  }
+  printf("Using %s at %u baud @%u/%u\n", slave, baudRate, addr, words);
+
+  // Set up the server with ID 1, answering FC 0x03
+  ModbusServerRTU server(2000, [&serverPort](bool level) { serverPort.setRTS(level); });
+  server.registerWorker(1, READ_HOLD_REGISTER, &FC03);
+  server.begin(serverPort, serverPort.baudRate());
+
+  // Set up the client
+  ModbusClientRTU client([&clientPort](bool level) { clientPort.setRTS(level); });
+  client.setTimeout(1000);
+  client.begin(clientPort, clientPort.baudRate());
+
+  // Issue a request and wait for the response
+  ModbusMessage response = client.syncRequest((uint32_t)millis(), 1, READ_HOLD_REGISTER, addr, words);
+  Error err = response.getError();
+  if (err != SUCCESS) {
+    ModbusError e(err);
+    printf("Error response: %02X - %s\n", (int)e, (const char *)e);
+  } else {
+    HEXDUMP_N("Response", response.data(), response.size());
+  }
+
+  // Stop the worker threads before the serial ports are closed
+  client.end();
+  server.end();
+
+  return err == SUCCESS ? 0 : 1;
+}
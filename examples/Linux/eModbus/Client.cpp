@@ -10,15 +10,15 @@
 #include <libexplain/connect.h>
 
 // Default constructor: just initialize host variables
-Client::Client() : sockfd(-1), host(NIL_ADDR), port(0) { } 
+Client::Client() : sockfd(-1), host(NIL_ADDR), port(0), noDelay(false), isConnected(false), rxHead(0), rxTail(0) { } 
 
 // Constructor with IP/port: initialize, then try to connect
-Client::Client(IPAddress ip, uint16_t p) : sockfd(-1), host(NIL_ADDR), port(0) {
+Client::Client(IPAddress ip, uint16_t p) : sockfd(-1), host(NIL_ADDR), port(0), noDelay(false), isConnected(false), rxHead(0), rxTail(0) {
   connect(ip, p);
 }
 
 // Constructor with hostname/port: initialize, then try to connect
-Client::Client(const char *hostname, uint16_t p) : sockfd(-1), host(NIL_ADDR), port(0) {
+Client::Client(const char *hostname, uint16_t p) : sockfd(-1), host(NIL_ADDR), port(0), noDelay(false), isConnected(false), rxHead(0), rxTail(0) {
   connect(hostname, p);
 }
 
@@ -27,13 +27,14 @@ Client::~Client() { stop(); }
 
 // connect with IP/port: establish a connection
 int Client::connect(IPAddress ip, uint16_t p) {
-// Are we still connected? Then terminate the existing connection.
-  if (connected()) disconnect();
+// Do we still have a socket? Then terminate the existing connection.
+  if (sockfd >= 0) disconnect();
 
 // Get a fresh socket
   sockfd = ::socket(AF_INET, SOCK_STREAM, 0);
   if (sockfd < 0) {
     LOG_E("Error %d opening socket\n", errno);
+    return -1;
   }
 
 // Set up sockaddr_in struct
@@ -52,13 +53,18 @@ int Client::connect(IPAddress ip, uint16_t p) {
   // Yes. Print out error and return
     LOG_E("Error %d connecting to %s:%d -\n", rc, buf, p);
     LOG_E("%s\n\n", explain_connect(sockfd, (struct sockaddr *)&server, sizeof(server)));
+    ::close(sockfd);
+    sockfd = -1;
     return rc;
   }
 
 // Connection was successful. Remember host data and return
   LOG_D("Connected.\n");
+  if (noDelay) setNoDelay(true);
   host = ip;
   port = p;
+  isConnected = true;
+  rxHead = rxTail = 0;
   return 0;
 }
 
@@ -95,93 +101,99 @@ bool Client::disconnect() {
   }
   host = NIL_ADDR;
   port = 0;
+  isConnected = false;
+  rxHead = rxTail = 0;
   return true;
 }
 
 // write (single byte): send out 1 byte
 size_t Client::write(uint8_t t) {
-// Send byte, disabled SIGPIPE
-  int rc = ::send(sockfd, &t, 1, MSG_NOSIGNAL);
-  LOG_D("send '%c' -> %d\n", (t > ' ' ? (char)t : '.'), rc);
-// Something wrong?
-  if (rc <= 0) {
-  // Yes, print it out
-    LOG_E("Error sending: %s (%d)\n", strerror(errno), errno);
-    return 0;
-  }
-  return 1;
+  return write(&t, 1);
 }
 
 // write (buffer): send block of data
 size_t Client::write(const uint8_t *buf, size_t size) {
-// Send buffer, disabled SIGPIPE
-  int rc = ::send(sockfd, buf, size, MSG_NOSIGNAL);
-  LOG_D("send buffer[%d] -> %d\n", size, rc);
-// Something wrong?
-  if (rc <= 0) {
-  // Yes, print it out
-    LOG_E("Error sending: %s (%d)\n", strerror(errno), errno);
-    return 0;
+  size_t sent = 0;
+  while (sent < size) {
+  // Send buffer, disabled SIGPIPE
+    int rc = ::send(sockfd, buf + sent, size - sent, MSG_NOSIGNAL);
+    LOG_D("send buffer[%d] -> %d\n", size - sent, rc);
+  // Something wrong?
+    if (rc <= 0) {
+      if (rc < 0 && errno == EINTR) continue;
+    // Yes, print it out. The connection is gone.
+      LOG_E("Error sending: %s (%d)\n", strerror(errno), errno);
+      isConnected = false;
+      break;
+    }
+    sent += rc;
   }
-  return rc;
+  return sent;
 }
 
-// available: return number of waiting bytes to be read - if any (but 255 max)
-int Client::available() {
-  uint8_t buf[256];
+// fill: one recv() for whatever the socket has, appended to the receive buffer.
+// Returns the number of bytes added.
+int Client::fill() {
+  if (sockfd < 0 || !isConnected) return 0;
+// Move the unread data to the front to make room
+  if (rxHead) {
+    memmove(rxBuf, rxBuf + rxHead, rxTail - rxHead);
+    rxTail -= rxHead;
+    rxHead = 0;
+  }
+  if (rxTail >= CLIENT_RXBUFSIZE) return 0;
 interrupted:
-// peek-read buffer
-  int r = ::recv(sockfd, &buf, 256, MSG_DONTWAIT|MSG_PEEK);
-// Anything >0 is number of bytes available
-  if (r > 0) return r;
-// We may have been prevented to read
-  if (r < 0 && errno == EINTR) goto interrupted;
-// All else is either an empty buffer or no connection at all
+  int r = ::recv(sockfd, rxBuf + rxTail, CLIENT_RXBUFSIZE - rxTail, MSG_DONTWAIT);
+// Got some data?
+  if (r > 0) {
+    rxTail += r;
+    return r;
+  }
+// The other side has closed the connection?
+  if (r == 0) {
+    LOG_D("Connection closed by peer\n");
+    isConnected = false;
+    return 0;
+  }
+// Check errno for the reasons
+  switch (errno) {
+  case EINTR:       goto interrupted;
+  case EAGAIN:      break;  // empty rx queue
+  default:          // Assume closed...
+    LOG_D("recv error: %s (%d)\n", strerror(errno), errno);
+    isConnected = false;
+    break;
+  }
   return 0;
 }
 
-// read: get a single byte from buffer
+// available: return number of waiting bytes to be read - if any
+int Client::available() {
+// Only ask the socket if the buffer is empty
+  if (rxHead == rxTail) fill();
+  return rxTail - rxHead;
+}
+
+// read: get a single byte from buffer, -1 if there is none
 int Client::read() {
-  int x;
-interrupted:
-// read a byte
-  int r = ::read(sockfd, &x, 1);
-// a 1 signals success
-  if (r == 1) return x;
-// We may have been prevented to read
-  if (r < 0 && errno == EINTR) goto interrupted;
-// A zero signals no data available
-  if (r == 0) return -1;
-// All else is some error state
-// Lazyness... No error handling here!
-  return r;
+  if (rxHead == rxTail && !fill()) return -1;
+  return rxBuf[rxHead++];
 }
 
-// read: get a buffer full of data
+// read: get a buffer full of data. Returns the number of bytes copied, 0 if there were none.
 int Client::read(uint8_t *buf, size_t size) {
-interrupted:
-// peek-read buffer
-  int r = ::read(sockfd, buf, size);
-// Anything >0 is number of bytes available
-  if (r > 0) return r;
-// We may have been prevented to read
-  if (r < 0 && errno == EINTR) goto interrupted;
-// All else is either an empty buffer or no connection at all
-  return 0;
+  if (rxHead == rxTail && !fill()) return 0;
+  size_t len = rxTail - rxHead;
+  if (len > size) len = size;
+  memcpy(buf, rxBuf + rxHead, len);
+  rxHead += len;
+  return len;
 }
 
 // peek: read one byte without popping it from the buffer
 int Client::peek() {
-  int x;
-interrupted:
-// peek-read a byte
-  int r = ::recv(sockfd, &x, 1, MSG_DONTWAIT|MSG_PEEK);
-// a 1 signals success
-  if (r == 1) return x;
-// We may have been prevented to read
-  if (r < 0 && errno == EINTR) goto interrupted;
-// All else is some error state
-  return r;
+  if (rxHead == rxTail && !fill()) return -1;
+  return rxBuf[rxHead];
 }
 
 // flush: no op for now
@@ -190,35 +202,24 @@ void Client::flush() {
 
 // stop: empty buffers and close connection
 void Client::stop() {
-  if (connected()) disconnect();
+  if (sockfd >= 0) disconnect();
 }
 
-// connected: return stat eof current host connetion
+// connected: return state of current host connection. Data not read yet counts as connected.
 uint8_t Client::connected() {
-  char x;
-interrupted:
-// Try to peek a byte
-  int r = ::recv(sockfd, &x, 1, MSG_DONTWAIT|MSG_PEEK);
-// Unsuccessful?
-  if (r < 0) {
-  // Check errno for the reasons
-    switch (errno) {
-    case EINTR:     goto interrupted;
-    case EAGAIN:    break; // empty rx queue
-    case ETIMEDOUT: break; // recv timeout
-    case ENOTCONN:  r = 0; break; // not connected yet
-    default:        r = 0; break; // Assume closed...
-    }
-  }
-  LOG_D("returns %d (r=%d, errno=%d, %s)\n", ((r != 0) ? 1 : 0), r, errno, strerror(errno));
-  return ((r != 0) ? 1 : 0);
+// Nothing buffered? Then see if the connection is still alive, taking any data arrived
+  if (rxHead == rxTail) fill();
+  return (rxHead != rxTail || isConnected) ? 1 : 0;
 }
 
 // bool operator: return connected() state
 Client::operator bool() { return connected() == 1; }
 
-// setNoDelay: disable Nagle algorithm for fast handling of small data packets
+// setNoDelay: disable Nagle algorithm for fast handling of small data packets.
+// The setting is kept for subsequent connections.
 void Client::setNoDelay(bool yesNo) {
+  noDelay = yesNo;
+  if (sockfd < 0) return;
   int yes = (yesNo ? 1 : 0);
   setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, (char *) &yes, sizeof(int));
 }
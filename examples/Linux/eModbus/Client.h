@@ -17,6 +17,10 @@
 #include <netdb.h> 
 #include "IPAddress.h"
 
+#define CLIENT_RXBUFSIZE 2048
+
+// Client: the Arduino Client class on a TCP socket. Received data is buffered, so
+// available(), read() and peek() need one recv() per arrival of data, not per call.
 class Client {
 public:
   Client();
@@ -40,10 +44,18 @@ public:
   static IPAddress hostname_to_ip(const char *hostname);
 
 protected:
+  // fill: take whatever the socket has into the receive buffer, without waiting
+  int fill();
+
   int sockfd;
   IPAddress host;
   uint16_t port;
   struct sockaddr_in server;
+  bool noDelay;              // TCP_NODELAY to be set on every new connection
+  bool isConnected;          // Connection state, as seen by the last recv() or send()
+  uint8_t rxBuf[CLIENT_RXBUFSIZE];  // Received data
+  uint16_t rxHead;           // Next byte to read from rxBuf
+  uint16_t rxTail;           // End of the data in rxBuf
 };
 
 #endif // IS_LINUX
@@ -0,0 +1,156 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#include "options.h"
+
+#if IS_LINUX
+#include "RTUbus.h"
+#include <chrono>  // NOLINT
+#undef LOCAL_LOG_LEVEL
+#include "Logging.h"
+
+using std::chrono::steady_clock;
+using std::chrono::microseconds;
+
+// Constructor: calculate the character time
+RTUbus::RTUbus(uint32_t baudRate, uint8_t bitsPerChar) :
+  RB_baudRate(baudRate),
+  RB_charTime((bitsPerChar * 1000000UL + baudRate - 1) / baudRate),
+  RB_busyUntil(0),
+  RB_collisions(0),
+  RB_bytesSent(0) { }
+
+// attach: add a port to the bus
+RTUbus::Port& RTUbus::attach() {
+  LOCK_GUARD(lockGuard, RB_lock);
+  RB_ports.emplace_back(new Port(*this));
+  return *RB_ports.back();
+}
+
+// Statistics
+uint32_t RTUbus::collisions() {
+  LOCK_GUARD(lockGuard, RB_lock);
+  return RB_collisions;
+}
+
+uint32_t RTUbus::bytesSent() {
+  LOCK_GUARD(lockGuard, RB_lock);
+  return RB_bytesSent;
+}
+
+void RTUbus::resetStatistics() {
+  LOCK_GUARD(lockGuard, RB_lock);
+  RB_collisions = 0;
+  RB_bytesSent = 0;
+}
+
+// now: microseconds on the steady clock, same base as micros()
+uint64_t RTUbus::now() {
+  return std::chrono::duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// transmit: schedule the bytes on the line and hand them to all other ports
+void RTUbus::transmit(Port& from, const uint8_t *data, size_t len) {
+  {
+    LOCK_GUARD(lockGuard, RB_lock);
+    uint64_t start = now() + from.PB_turnaround;
+
+    // Is someone else talking? That would garble both messages on a real line.
+    if (start < RB_busyUntil && from.PB_txEnd < RB_busyUntil) {
+      RB_collisions++;
+      LOG_W("Collision on the bus\n");
+    }
+    // Simulated devices are no faster than their response delay
+    if (start < from.PB_lastRx + from.PB_responseDelay) start = from.PB_lastRx + from.PB_responseDelay;
+    // Line is serialized
+    if (start < RB_busyUntil) start = RB_busyUntil;
+
+    uint64_t at = start;
+    auto deliver = [&](uint8_t b) {
+      at += RB_charTime;
+      for (auto& p : RB_ports) {
+        if (p.get() != &from) p->PB_rx.push_back({ at, b });
+      }
+      RB_bytesSent++;
+    };
+    if (from.PB_leadingZero) deliver(0x00);
+    for (size_t i = 0; i < len; ++i) deliver(data[i]);
+
+    RB_busyUntil = at;
+    from.PB_txEnd = at;
+  }
+  RB_signal.notify_all();
+}
+
+// Port constructor: nothing sent or received yet
+RTUbus::Port::Port(RTUbus& bus) :
+  PB_bus(bus),
+  PB_txEnd(0),
+  PB_lastRx(0),
+  PB_responseDelay(0),
+  PB_turnaround(0),
+  PB_leadingZero(false) { }
+
+// available: number of bytes that have completely arrived
+int RTUbus::Port::available() {
+  std::lock_guard<std::mutex> lockGuard(PB_bus.RB_lock);
+  uint64_t t = now();
+  int cnt = 0;
+  for (auto& b : PB_rx) {
+    if (b.at > t) break;
+    cnt++;
+  }
+  return cnt;
+}
+
+// read: take the next byte, if it has arrived
+int RTUbus::Port::read() {
+  std::lock_guard<std::mutex> lockGuard(PB_bus.RB_lock);
+  if (PB_rx.empty() || PB_rx.front().at > now()) return -1;
+  uint8_t b = PB_rx.front().data;
+  PB_lastRx = PB_rx.front().at;
+  PB_rx.pop_front();
+  return b;
+}
+
+// peek: look at the next byte, if it has arrived
+int RTUbus::Port::peek() {
+  std::lock_guard<std::mutex> lockGuard(PB_bus.RB_lock);
+  if (PB_rx.empty() || PB_rx.front().at > now()) return -1;
+  return PB_rx.front().data;
+}
+
+// write: put data on the line. Like a UART, this returns before the data is sent.
+size_t RTUbus::Port::write(const uint8_t *buf, size_t size) {
+  if (size) PB_bus.transmit(*this, buf, size);
+  return size;
+}
+
+// flush: wait until the transmission is done
+void RTUbus::Port::flush() {
+  uint64_t end;
+  {
+    std::lock_guard<std::mutex> lockGuard(PB_bus.RB_lock);
+    end = PB_txEnd;
+  }
+  uint64_t t = now();
+  if (end > t) delayMicroseconds(end - t);
+}
+
+// waitAvailable: sleep until the next byte has arrived, or the timeout has passed
+bool RTUbus::Port::waitAvailable(uint32_t timeoutMicros) {
+  std::unique_lock<std::mutex> lockGuard(PB_bus.RB_lock);
+  uint64_t deadline = now() + timeoutMicros;
+  while (true) {
+    uint64_t t = now();
+    if (!PB_rx.empty() && PB_rx.front().at <= t) return true;
+    if (t >= deadline) return false;
+    // Sleep until the next byte is due, the deadline is reached or new data is sent
+    uint64_t wake = deadline;
+    if (!PB_rx.empty() && PB_rx.front().at < wake) wake = PB_rx.front().at;
+    PB_bus.RB_signal.wait_until(lockGuard, steady_clock::time_point(microseconds(wake)));
+  }
+}
+
+#endif // IS_LINUX
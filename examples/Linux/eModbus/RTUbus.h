@@ -0,0 +1,103 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _RTUBUS_H
+#define _RTUBUS_H
+#include "options.h"
+
+#if IS_LINUX
+#include "Stream.h"
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>                    // NOLINT
+#include <condition_variable>       // NOLINT
+
+// RTUbus: a simulated RS485 multi-drop line to test and benchmark RTU clients and servers
+// without hardware. Every device attaches a Port, which is a Stream. Bytes written to one
+// port arrive at all others one character time apart, as they would on a real line.
+// A transmission starts
+// - not before the line is free again. Overlapping ones are counted as collisions.
+// - after the port's turnaround time, modelling the RS485 driver enable.
+// - not earlier than the port's response delay after its last received byte, modelling a
+//   slow device.
+class RTUbus {
+public:
+  class Port : public Stream {
+  public:
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(const uint8_t *buf, size_t size) override;
+    using Stream::write;
+    // flush: wait until the last transmission has left the port
+    void flush() override;
+    bool waitAvailable(uint32_t timeoutMicros) override;
+
+    uint32_t baudRate() { return PB_bus.baudRate(); }
+    // setResponseDelay: minimum time between the end of a received frame and an answer
+    void setResponseDelay(uint32_t us) { PB_responseDelay = us; }
+    // setTurnaround: time to switch the port from receive to transmit
+    void setTurnaround(uint32_t us) { PB_turnaround = us; }
+    // setLeadingZero: send a 0x00 in front of every transmission, like some drivers do
+    void setLeadingZero(bool onOff = true) { PB_leadingZero = onOff; }
+
+  protected:
+    friend class RTUbus;
+    explicit Port(RTUbus& bus);
+    // Prevent copy construction or assignment
+    Port(Port& other) = delete;
+    Port& operator=(Port& other) = delete;
+
+    struct RxByte {
+      uint64_t at;                      // Time the byte is completely received
+      uint8_t data;
+    };
+
+    RTUbus& PB_bus;                     // The bus this port is attached to
+    std::deque<RxByte> PB_rx;           // Bytes received or still on their way
+    uint64_t PB_txEnd;                  // End of the last transmission of this port
+    uint64_t PB_lastRx;                 // End of the last byte received
+    uint32_t PB_responseDelay;          // Minimum gap between a received byte and a transmission
+    uint32_t PB_turnaround;             // Delay before a transmission starts
+    bool PB_leadingZero;                // true: precede every transmission by a 0x00 byte
+  };
+
+  // Constructor: line speed and character length (start, data, parity and stop bits)
+  explicit RTUbus(uint32_t baudRate, uint8_t bitsPerChar = 10);
+
+  // attach: connect a new device to the bus. The port lives as long as the bus.
+  Port& attach();
+
+  uint32_t baudRate() { return RB_baudRate; }
+  // charTime: microseconds to transmit one character
+  uint32_t charTime() { return RB_charTime; }
+  // Statistics
+  uint32_t collisions();
+  uint32_t bytesSent();
+  void resetStatistics();
+
+  // now: the bus' time base in microseconds
+  static uint64_t now();
+
+protected:
+  // Prevent copy construction or assignment
+  RTUbus(RTUbus& other) = delete;
+  RTUbus& operator=(RTUbus& other) = delete;
+
+  // transmit: put a block of data from port onto the line
+  void transmit(Port& from, const uint8_t *data, size_t len);
+
+  uint32_t RB_baudRate;                 // Line speed
+  uint32_t RB_charTime;                 // Microseconds per character
+  uint64_t RB_busyUntil;                // End of the current transmission on the line
+  uint32_t RB_collisions;               // Number of overlapping transmissions
+  uint32_t RB_bytesSent;                // Number of bytes transmitted
+  std::list<std::unique_ptr<Port>> RB_ports; // Attached devices
+  std::mutex RB_lock;                   // Protecting all of the above and the ports
+  std::condition_variable RB_signal;    // Notifying ports of new data
+};
+
+#endif // IS_LINUX
+#endif // _RTUBUS_H
@@ -0,0 +1,210 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#include "options.h"
+
+#if IS_LINUX
+#include "SerialPort.h"
+#include "Logging.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+// Constructor: no device yet
+SerialPort::SerialPort() : SP_fd(-1), SP_baudRate(0), SP_peeked(-1) { }
+
+// Destructor: close device, if open
+SerialPort::~SerialPort() { end(); }
+
+// begin: open device, then set it up
+bool SerialPort::begin(const char *device, uint32_t baudRate, char parity, uint8_t stopBits) {
+  int fd = ::open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0) {
+    LOG_E("Error %d opening %s\n", errno, device);
+    return false;
+  }
+  return begin(fd, baudRate, parity, stopBits);
+}
+
+// begin: set up an open file descriptor as raw serial line
+bool SerialPort::begin(int fd, uint32_t baudRate, char parity, uint8_t stopBits) {
+  // Close a previously used device
+  end();
+
+  speed_t spd = speed(baudRate);
+  if (spd == B0) {
+    LOG_E("Unsupported baud rate %u\n", baudRate);
+    ::close(fd);
+    return false;
+  }
+
+  // Reads must not block - we are waiting with poll()
+  ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  struct termios tio;
+  if (::tcgetattr(fd, &tio) < 0) {
+    LOG_E("Error %d getting line parameters\n", errno);
+    ::close(fd);
+    return false;
+  }
+
+  // Raw 8 bit data, no flow control, no modem status lines
+  ::cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~(CRTSCTS | PARENB | PARODD | CSTOPB);
+  if (parity == 'E' || parity == 'e') {
+    tio.c_cflag |= PARENB;
+  } else if (parity == 'O' || parity == 'o') {
+    tio.c_cflag |= PARENB | PARODD;
+  }
+  if (stopBits == 2) {
+    tio.c_cflag |= CSTOPB;
+  }
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  ::cfsetispeed(&tio, spd);
+  ::cfsetospeed(&tio, spd);
+
+  if (::tcsetattr(fd, TCSANOW, &tio) < 0) {
+    LOG_E("Error %d setting line parameters\n", errno);
+    ::close(fd);
+    return false;
+  }
+  ::tcflush(fd, TCIOFLUSH);
+
+  SP_fd = fd;
+  SP_baudRate = baudRate;
+  SP_peeked = -1;
+  LOG_D("Serial line open, %u baud %c%u\n", baudRate, parity, stopBits);
+  return true;
+}
+
+// end: close device
+void SerialPort::end() {
+  if (SP_fd >= 0) {
+    ::close(SP_fd);
+    SP_fd = -1;
+  }
+  SP_peeked = -1;
+}
+
+// available: number of bytes waiting to be read
+int SerialPort::available() {
+  int cnt = 0;
+  if (SP_fd < 0 || ::ioctl(SP_fd, FIONREAD, &cnt) < 0) cnt = 0;
+  return cnt + (SP_peeked >= 0 ? 1 : 0);
+}
+
+// read: get a single byte without waiting. -1 if there is none.
+int SerialPort::read() {
+  if (SP_peeked >= 0) {
+    int c = SP_peeked;
+    SP_peeked = -1;
+    return c;
+  }
+  uint8_t c;
+  if (SP_fd >= 0 && ::read(SP_fd, &c, 1) == 1) return c;
+  return -1;
+}
+
+// peek: look at the next byte without taking it
+int SerialPort::peek() {
+  if (SP_peeked < 0) SP_peeked = read();
+  return SP_peeked;
+}
+
+// readBytes: read up to length bytes, waiting no longer than the timeout for the next byte
+size_t SerialPort::readBytes(uint8_t *buffer, size_t length) {
+  size_t count = 0;
+  if (length && SP_peeked >= 0) {
+    buffer[count++] = (uint8_t)read();
+  }
+  while (SP_fd >= 0 && count < length) {
+    ssize_t got = ::read(SP_fd, buffer + count, length - count);
+    if (got > 0) {
+      count += got;
+    } else if (got < 0 && errno != EAGAIN && errno != EINTR) {
+      LOG_E("Error %d reading serial line\n", errno);
+      break;
+    } else if (!waitFor(POLLIN, _timeout)) {
+      break;
+    }
+  }
+  return count;
+}
+
+// write: send a block of data, waiting for the device to accept all of it
+size_t SerialPort::write(const uint8_t *buf, size_t size) {
+  size_t count = 0;
+  while (SP_fd >= 0 && count < size) {
+    ssize_t put = ::write(SP_fd, buf + count, size - count);
+    if (put > 0) {
+      count += put;
+    } else if (put < 0 && errno != EAGAIN && errno != EINTR) {
+      LOG_E("Error %d writing serial line\n", errno);
+      break;
+    } else if (!waitFor(POLLOUT, _timeout)) {
+      break;
+    }
+  }
+  return count;
+}
+
+// flush: wait until all data written has been transmitted
+void SerialPort::flush() {
+  if (SP_fd >= 0) ::tcdrain(SP_fd);
+}
+
+// waitAvailable: sleep until the device has data, or the timeout has passed
+bool SerialPort::waitAvailable(uint32_t timeoutMicros) {
+  if (SP_peeked >= 0) return true;
+  if (SP_fd < 0) return false;
+  struct pollfd pfd = { SP_fd, POLLIN, 0 };
+  struct timespec ts = { (time_t)(timeoutMicros / 1000000), (long)(timeoutMicros % 1000000) * 1000L };
+  return ::ppoll(&pfd, 1, &ts, NULL) > 0 && (pfd.revents & POLLIN);
+}
+
+// setRTS: set or clear the RTS line. Pseudo terminals do not have one - ignore the error.
+void SerialPort::setRTS(bool level) {
+  int bits = TIOCM_RTS;
+  if (SP_fd >= 0 && ::ioctl(SP_fd, level ? TIOCMBIS : TIOCMBIC, &bits) < 0) {
+    LOG_V("Error %d setting RTS\n", errno);
+  }
+}
+
+// waitFor: poll() the device for events
+bool SerialPort::waitFor(short events, int timeout) {
+  struct pollfd pfd = { SP_fd, events, 0 };
+  int rc;
+  do {
+    rc = ::poll(&pfd, 1, timeout);
+  } while (rc < 0 && errno == EINTR);
+  return rc > 0 && (pfd.revents & events);
+}
+
+// speed: map baud rates to termios constants
+speed_t SerialPort::speed(uint32_t baudRate) {
+  switch (baudRate) {
+  case 1200: return B1200;
+  case 2400: return B2400;
+  case 4800: return B4800;
+  case 9600: return B9600;
+  case 19200: return B19200;
+  case 38400: return B38400;
+  case 57600: return B57600;
+  case 115200: return B115200;
+  case 230400: return B230400;
+#ifdef B460800
+  case 460800: return B460800;
+#endif
+#ifdef B921600
+  case 921600: return B921600;
+#endif
+  default: return B0;
+  }
+}
+
+#endif // IS_LINUX
@@ -0,0 +1,63 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _SERIALPORT_H
+#define _SERIALPORT_H
+#include "options.h"
+
+#if IS_LINUX
+#include "Stream.h"
+#include <termios.h>
+
+// SerialPort: a Stream on a Linux serial device (or pseudo terminal), configured raw by termios.
+// Reads never block longer than the Stream timeout, flush() waits until all data has left the
+// UART (tcdrain), so an RTS callback switching the RS485 direction after flush() is safe.
+// waitAvailable() sleeps in ppoll() with microsecond resolution until data arrives.
+class SerialPort : public Stream {
+public:
+  SerialPort();
+  ~SerialPort();
+
+  // begin: open device and set line parameters. parity is one of 'N', 'E' or 'O'.
+  bool begin(const char *device, uint32_t baudRate, char parity = 'N', uint8_t stopBits = 1);
+  // begin: same for an already open file descriptor, like the master side of a pty.
+  // The SerialPort takes ownership of fd and will close it in end().
+  bool begin(int fd, uint32_t baudRate, char parity = 'N', uint8_t stopBits = 1);
+  // end: close the device
+  void end();
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t readBytes(uint8_t *buffer, size_t length) override;
+  using Stream::readBytes;
+  size_t write(const uint8_t *buf, size_t size) override;
+  using Stream::write;
+  void flush() override;
+  bool waitAvailable(uint32_t timeoutMicros) override;
+
+  // setRTS: set the RTS modem control line, to be used in a RTScallback
+  void setRTS(bool level);
+
+  uint32_t baudRate() { return SP_baudRate; }
+  int fd() { return SP_fd; }
+  operator bool() { return SP_fd >= 0; }
+
+protected:
+  // Prevent copy construction or assignment
+  SerialPort(SerialPort& other) = delete;
+  SerialPort& operator=(SerialPort& other) = delete;
+
+  // waitFor: poll() for the given events, at most timeout milliseconds. true if one occurred.
+  bool waitFor(short events, int timeout);
+  // speed: termios speed constant for a baud rate, B0 if there is none
+  static speed_t speed(uint32_t baudRate);
+
+  int SP_fd;                   // File descriptor of the device, -1 if closed
+  uint32_t SP_baudRate;        // Baud rate set in begin()
+  int SP_peeked;               // Byte read ahead by peek(), -1 if none
+};
+
+#endif // IS_LINUX
+#endif // _SERIALPORT_H
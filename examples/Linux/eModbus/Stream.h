@@ -0,0 +1,59 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _STREAM_H
+#define _STREAM_H
+#include "options.h"
+
+#if IS_LINUX
+#include <cstddef>
+
+// Stream: the subset of the Arduino Stream interface the RTU functions are using
+class Stream {
+public:
+  Stream() : _timeout(1000) {}
+  virtual ~Stream() {}
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual size_t write(const uint8_t *buf, size_t size) = 0;
+  virtual size_t write(uint8_t b) { return write(&b, 1); }
+  virtual void flush() = 0;
+
+  // readBytes: read up to length bytes, waiting no longer than the timeout for each byte
+  virtual size_t readBytes(uint8_t *buffer, size_t length) {
+    size_t count = 0;
+    unsigned long start = millis();
+    while (count < length) {
+      int c = read();
+      if (c >= 0) {
+        buffer[count++] = (uint8_t)c;
+        start = millis();
+      } else if (millis() - start >= _timeout) {
+        break;
+      } else {
+        delay(1);
+      }
+    }
+    return count;
+  }
+  size_t readBytes(char *buffer, size_t length) { return readBytes((uint8_t *)buffer, length); }
+
+  // waitAvailable: sleep until data is available or timeoutMicros have passed. true if there is data.
+  // This default is sleeping 1ms at most, so a Stream without an event source will still work.
+  virtual bool waitAvailable(uint32_t timeoutMicros) {
+    if (available() > 0) return true;
+    delayMicroseconds(timeoutMicros < 1000 ? timeoutMicros : 1000);
+    return available() > 0;
+  }
+
+  void setTimeout(unsigned long timeout) { _timeout = timeout; }
+  unsigned long getTimeout() { return _timeout; }
+
+protected:
+  unsigned long _timeout;      // Number of milliseconds to wait for the next byte in readBytes()
+};
+
+#endif // IS_LINUX
+#endif // _STREAM_H
@@ -0,0 +1,83 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _MBAP_FRAMER_H
+#define _MBAP_FRAMER_H
+#include <stdint.h>
+#include <string.h>
+
+#define MBAP_BUFSIZE 1024   // Room for several responses - at least one complete one
+#define MBAP_MAXLEN 254     // Largest MBAP length value: server ID plus the largest PDU
+
+// MBAPFramer: collects data received over Modbus TCP and cuts it into frames by the length
+// field of the MBAP header. Data may arrive in any number of pieces; anything beyond the
+// first frame is kept for the next one.
+// Usage: put received data at space() and tell added() how much it was. While state() is
+// COMPLETE, frame() has the first frame with its header, pop() removes it.
+class MBAPFramer {
+public:
+  enum State : uint8_t {
+    INCOMPLETE = 0,   // Need more data
+    COMPLETE,         // frame() is a complete frame
+    BROKEN            // Invalid header - the data will never make up a frame
+  };
+
+  MBAPFramer() :
+    MF_head(0),
+    MF_tail(0) {}
+
+  // clear: drop all data
+  inline void clear() { MF_head = MF_tail = 0; }
+
+  // size: number of bytes held
+  inline uint16_t size() const { return MF_tail - MF_head; }
+
+  // space: where received data is to be put. room is set to the number of bytes fitting there.
+  uint8_t *space(uint16_t& room) {
+    // Move the remainder to the front if there is not enough room for a complete frame behind it
+    if (MF_head && MBAP_BUFSIZE - MF_tail < MBAP_MAXLEN + 6) {
+      memmove(MF_buf, MF_buf + MF_head, size());
+      MF_tail -= MF_head;
+      MF_head = 0;
+    }
+    room = MBAP_BUFSIZE - MF_tail;
+    return MF_buf + MF_tail;
+  }
+
+  // added: n bytes were put at space()
+  inline void added(uint16_t n) { MF_tail += n; }
+
+  // state: check if a frame is complete
+  State state() const {
+    if (size() < 6) return INCOMPLETE;
+    // A protocolID other than 0 or an impossible length: we have lost track of the framing
+    if (MF_buf[MF_head + 2] || MF_buf[MF_head + 3] || length() < 2 || length() > MBAP_MAXLEN) return BROKEN;
+    return size() < length() + 6 ? INCOMPLETE : COMPLETE;
+  }
+
+  // frame: first frame, starting with the MBAP header
+  inline const uint8_t *frame() const { return MF_buf + MF_head; }
+
+  // frameSize: length of the first frame, header included
+  inline uint16_t frameSize() const { return length() + 6; }
+
+  // transactionID: transactionID of the first frame
+  inline uint16_t transactionID() const { return (MF_buf[MF_head] << 8) | MF_buf[MF_head + 1]; }
+
+  // length: MBAP length field of the first frame - server ID and PDU
+  inline uint16_t length() const { return (MF_buf[MF_head + 4] << 8) | MF_buf[MF_head + 5]; }
+
+  // pop: remove the first frame. Only allowed if state() is COMPLETE!
+  void pop() {
+    MF_head += frameSize();
+    if (MF_head >= MF_tail) clear();
+  }
+
+protected:
+  uint8_t MF_buf[MBAP_BUFSIZE];   // Received data
+  uint16_t MF_head;               // Start of the first frame
+  uint16_t MF_tail;               // End of the data
+};
+
+#endif  // _MBAP_FRAMER_H
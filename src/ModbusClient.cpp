@@ -20,7 +20,9 @@ ModbusClient::ModbusClient() :
   #endif
   onData(nullptr),
   onError(nullptr),
-  onResponse(nullptr) { 
+  onResponse(nullptr),
+  onDataView(nullptr),
+  onResponseView(nullptr) { 
     instanceCounter++; 
     instanceID++; 
     myInstance = instanceID; 
@@ -35,13 +37,27 @@ ModbusClient::~ModbusClient() {
 
 // onDataHandler: register callback for data responses
 bool ModbusClient::onDataHandler(MBOnData handler) {
-  if (onData) {
+  if (onData || onDataView) {
     LOG_W("onData handler was already claimed\n");
-  } else if (onResponse) {
+  } else if (onResponse || onResponseView) {
     LOG_E("onData handler is unavailable with an onResponse handler\n");
     return false;
   }
   onData = handler;
+  onDataView = nullptr;
+  return true;
+}
+
+// onDataHandler: same for a handler taking a view on the response
+bool ModbusClient::onDataHandler(MBOnDataView handler) {
+  if (onData || onDataView) {
+    LOG_W("onData handler was already claimed\n");
+  } else if (onResponse || onResponseView) {
+    LOG_E("onData handler is unavailable with an onResponse handler\n");
+    return false;
+  }
+  onData = nullptr;
+  onDataView = handler;
   return true;
 }
 
@@ -49,7 +65,7 @@ bool ModbusClient::onDataHandler(MBOnData handler) {
 bool ModbusClient::onErrorHandler(MBOnError handler) {
   if (onError) {
     LOG_W("onError handler was already claimed\n");
-  } else if (onResponse) {
+  } else if (onResponse || onResponseView) {
     LOG_E("onError handler is unavailable with an onResponse handler\n");
     return false;
   } 
@@ -59,14 +75,54 @@ bool ModbusClient::onErrorHandler(MBOnError handler) {
 
 // onResponseHandler: register callback for error responses
 bool ModbusClient::onResponseHandler(MBOnResponse handler) {
-  if (onError || onData) {
+  if (onError || onData || onDataView) {
     LOG_E("onResponse handler is unavailable with an onData or onError handler\n");
     return false;
   } 
   onResponse = handler;
+  onResponseView = nullptr;
+  return true;
+}
+
+// onResponseHandler: same for a handler taking a view on the response
+bool ModbusClient::onResponseHandler(MBOnResponseView handler) {
+  if (onError || onData || onDataView) {
+    LOG_E("onResponse handler is unavailable with an onData or onError handler\n");
+    return false;
+  } 
+  onResponse = nullptr;
+  onResponseView = handler;
   return true;
 }
 
+// dispatchResponse: hand an async response to the onResponse or the onData/onError handlers
+void ModbusClient::dispatchResponse(const ModbusMessage& response, uint32_t token, Error error) {
+  // Do we have an onResponse handler?
+  if (onResponseView) {
+    // Yes. Call it.
+    onResponseView(ModbusMessageView(response), token);
+  } else if (onResponse) {
+    onResponse(response, token);
+  // No, but we may have onData or onError handlers. Did we get a normal response?
+  } else if (error == SUCCESS) {
+    // Yes. Do we have an onData handler registered?
+    if (onDataView) {
+      // Yes. call it
+      onDataView(ModbusMessageView(response), token);
+    } else if (onData) {
+      onData(response, token);
+    } else {
+      LOG_D("No handler for response!\n");
+    }
+  // No, something went wrong. All we have is an error. Do we have an onError handler?
+  } else if (onError) {
+    // Yes. Forward the error code to it
+    onError(error, token);
+  } else {
+    LOG_D("No onError handler\n");
+  }
+}
+
 // getMessageCount: return message counter value
 uint32_t ModbusClient::getMessageCount() {
   return messageCount;
@@ -86,30 +142,208 @@ void ModbusClient::resetCounts() {
   }
 }
 
+// prepareRequestM: default serialization is the message itself
+PreparedRequest ModbusClient::prepareRequestM(const ModbusMessage& msg) {
+  PreparedRequest p;
+  if (msg.size() >= 2) {
+    p.PR_frame = msg;
+    p.PR_error = SUCCESS;
+  }
+  return p;
+}
+
+// addPreparedM: default is to queue a copy of the request message
+Error ModbusClient::addPreparedM(const PreparedRequest& p, uint32_t token) {
+  if (!p.isValid()) return p.getError();
+  return addRequestM(ModbusMessage(p.request()), token);
+}
+
+// syncPreparedM: same for synchronous requests
+ModbusMessage ModbusClient::syncPreparedM(const PreparedRequest& p, uint32_t token) {
+  if (!p.isValid()) {
+    ModbusMessage response;
+    response.setError(p.request().getServerID(), p.request().getFunctionCode(), p.getError());
+    return response;
+  }
+  return syncRequestM(ModbusMessage(p.request()), token);
+}
+
+// addRequestD: default for clients not taking completion handlers
+Error ModbusClient::addRequestD(ModbusMessage /* msg */, MBOnDone /* done */) {
+  LOG_E("Completion handlers are not supported by this client\n");
+  return UNDEFINED_ERROR;
+}
+
+// readBlock: split a large read into requests of maximum size
+Error ModbusClient::readBlock(uint8_t serverID, uint8_t functionCode, uint16_t address, uint32_t count, MBOnBlock done) {
+  // Registers or coils?
+  uint16_t chunk = 0;
+  uint32_t bytes = 0;
+  if (functionCode == READ_HOLD_REGISTER || functionCode == READ_INPUT_REGISTER) {
+    chunk = 125;
+    bytes = count * 2;
+  } else if (functionCode == READ_COIL || functionCode == READ_DISCR_INPUT) {
+    // A multiple of 8, so each response starts on a byte boundary
+    chunk = 2000;
+    bytes = (count + 7) / 8;
+  } else {
+    return ILLEGAL_FUNCTION;
+  }
+  if (count == 0 || address + count > 0x10000) {
+    return PARAMETER_LIMIT_ERROR;
+  }
+
+  // State shared by all requests of the block
+  struct Block {
+    std::vector<uint8_t> data;          // Data collected so far
+    std::atomic<uint32_t> pending;      // Number of responses missing, plus one while queueing
+    std::atomic<uint8_t> error;         // First error seen
+    MBOnBlock done;                     // Result handler
+  };
+  std::shared_ptr<Block> block = std::make_shared<Block>();
+  block->data.resize(bytes);
+  block->error = SUCCESS;
+  block->done = done;
+  uint32_t requests = (count + chunk - 1) / chunk;
+  block->pending = requests + 1;
+
+  // finish: count down and deliver the result with the last response
+  auto finish = [](std::shared_ptr<Block>& b, uint32_t n) {
+    if (b->pending.fetch_sub(n) == n) {
+      Error e = static_cast<Error>(b->error.load());
+      if (e != SUCCESS) b->data.clear();
+      if (b->done) b->done(e, b->data);
+    }
+  };
+
+  for (uint32_t i = 0; i < requests; ++i) {
+    uint16_t addr = address + i * chunk;
+    uint16_t cnt = (count - i * chunk > chunk) ? chunk : count - i * chunk;
+    // Where does the response data go, how long is it?
+    uint32_t offset = (chunk == 125) ? i * chunk * 2 : i * chunk / 8;
+    uint16_t len = (chunk == 125) ? cnt * 2 : (cnt + 7) / 8;
+
+    ModbusMessage m;
+    Error rc = m.setMessage(serverID, functionCode, addr, cnt);
+    if (rc == SUCCESS) {
+      rc = addRequestD(m, [block, offset, len, finish](const ModbusMessage& response) mutable {
+        Error e = response.getError();
+        // Does the byte count match the request?
+        if (e == SUCCESS && (response.size() != len + 3 || response[2] != len)) {
+          e = PACKET_LENGTH_ERROR;
+        }
+        if (e == SUCCESS) {
+          memcpy(block->data.data() + offset, response.data() + 3, len);
+        } else {
+          uint8_t expected = SUCCESS;
+          block->error.compare_exchange_strong(expected, e);
+        }
+        finish(block, 1);
+      });
+    }
+    // Could not queue the request?
+    if (rc != SUCCESS) {
+      // First one? Then nothing was queued at all
+      if (i == 0) return rc;
+      // No. The error goes to the handler when the queued requests are through
+      uint8_t expected = SUCCESS;
+      block->error.compare_exchange_strong(expected, rc);
+      block->pending -= requests - i;
+      break;
+    }
+  }
+  // All queued. Let the last response finish the block
+  finish(block, 1);
+  return SUCCESS;
+}
+
+#if USE_MUTEX
+// readBlock: same, waiting for the result
+Error ModbusClient::readBlock(uint8_t serverID, uint8_t functionCode, uint16_t address, uint32_t count, std::vector<uint8_t>& data) {
+  std::shared_ptr<std::promise<Error>> p = std::make_shared<std::promise<Error>>();
+  std::future<Error> f = p->get_future();
+
+  Error rc = readBlock(serverID, functionCode, address, count, [p, &data](Error e, const std::vector<uint8_t>& d) {
+    data = d;
+    p->set_value(e);
+  });
+  if (rc != SUCCESS) return rc;
+  return f.get();
+}
+
+// asyncRequest: queue a request and get a future for its response
+std::future<ModbusMessage> ModbusClient::asyncRequest(const ModbusMessage& m) {
+  // The promise has to live until the worker has answered
+  std::shared_ptr<std::promise<ModbusMessage>> p = std::make_shared<std::promise<ModbusMessage>>();
+  std::future<ModbusMessage> f = p->get_future();
+
+  Error rc = addRequestD(m, [p](const ModbusMessage& response) { p->set_value(response); });
+  // Not queued? Then answer right away.
+  if (rc != SUCCESS) {
+    p->set_value(buildErrorMsg(rc, m.getServerID(), m.getFunctionCode()));
+  }
+  return f;
+}
+#endif
+
 // waitSync: wait for response on syncRequest to arrive
 ModbusMessage ModbusClient::waitSync(uint8_t serverID, uint8_t functionCode, uint32_t token) {
   ModbusMessage response;
-  unsigned long lostPatience = millis();
  
   // Default response is TIMEOUT
   response.setError(serverID, functionCode, TIMEOUT);
 
+#if USE_MUTEX
+  std::unique_lock<std::mutex> lock(syncRespM);
+  // Has the response arrived already?
+  auto sR = syncResponse.find(token);
+  if (sR != syncResponse.end()) {
+    // Yes. get the response, delete it from the map and return
+    response = sR->second;
+    syncResponse.erase(sR);
+    return response;
+  }
+  // No. Leave a slot for deliverSync() and sleep until it is filled - 60 seconds, if unlucky
+  SyncSlot slot;
+  syncSlots[token] = &slot;
+  if (slot.cv.wait_for(lock, std::chrono::seconds(60), [&slot] { return slot.done; })) {
+    response = slot.response;
+  }
+  syncSlots.erase(token);
+#else
+  unsigned long lostPatience = millis();
+
   // Loop 60 seconds, if unlucky
   while (millis() - lostPatience < 60000) {
-    {
-      LOCK_GUARD(lg, syncRespM);
-      // Look for the token
-      auto sR = syncResponse.find(token);
-      // Is it there?
-      if (sR != syncResponse.end()) {
-        // Yes. get the response, delete it from the map and return
-        response = sR->second;
-        syncResponse.erase(sR);
-        break;
-      }
+    // Look for the token
+    auto sR = syncResponse.find(token);
+    // Is it there?
+    if (sR != syncResponse.end()) {
+      // Yes. get the response, delete it from the map and return
+      response = sR->second;
+      syncResponse.erase(sR);
+      break;
     }
     // Give the watchdog time to act
-    delay(10);
+    delay(1);
   }
+#endif
   return response;
 }
+
+// deliverSync: hand a response over to the waiting syncRequest
+void ModbusClient::deliverSync(uint32_t token, const ModbusMessage& response) {
+  LOCK_GUARD(lg, syncRespM);
+#if USE_MUTEX
+  // Is the syncRequest waiting already? Then wake it up.
+  auto sS = syncSlots.find(token);
+  if (sS != syncSlots.end()) {
+    sS->second->response = response;
+    sS->second->done = true;
+    sS->second->cv.notify_one();
+    return;
+  }
+#endif
+  // No. Keep the response until it comes to fetch it.
+  syncResponse[token] = response;
+}
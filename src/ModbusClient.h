@@ -7,6 +7,9 @@
 
 #include <functional> 
 #include <map>
+#include <vector>
+#include <atomic>
+#include <memory>
 #include "options.h"
 #include "ModbusMessage.h"
 
@@ -26,24 +29,184 @@ extern "C" {
 
 #if USE_MUTEX
 #include <mutex>                    // NOLINT
+#include <condition_variable>       // NOLINT
+#include <future>                   // NOLINT
 using std::mutex;
 using std::lock_guard;
 #endif
 
+// C++20 coroutines available?
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define HAS_COROUTINES 1
+#endif
+#endif
+#ifndef HAS_COROUTINES
+#define HAS_COROUTINES 0
+#endif
+
 typedef std::function<void(ModbusMessage msg, uint32_t token)> MBOnData;
 typedef std::function<void(Modbus::Error errorCode, uint32_t token)> MBOnError;
 typedef std::function<void(ModbusMessage msg, uint32_t token)> MBOnResponse;
+// Handler variants getting a read-only view on the response instead of a copy.
+// The view is valid only until the handler returns!
+typedef std::function<void(ModbusMessageView msg, uint32_t token)> MBOnDataView;
+typedef std::function<void(ModbusMessageView msg, uint32_t token)> MBOnResponseView;
+// Completion handler of a single request. It gets the response instead of the handlers above.
+// It is called in the client's worker task!
+typedef std::function<void(const ModbusMessage& response)> MBOnDone;
+// Result handler of readBlock(). data holds the data bytes of all responses in a row: registers
+// MSB first, coils packed 8 to a byte, lowest address in bit 0. data is empty if there was an error.
+typedef std::function<void(Modbus::Error error, const std::vector<uint8_t>& data)> MBOnBlock;
+
+// PreparedRequest: a request serialized once into its complete frame by a client's
+// prepareRequest(). Queueing it again and again with addRequest() or syncRequest()
+// will only copy the frame - ModbusClientTCP patches in the transaction ID, 
+// ModbusClientRTU takes the precomputed CRC.
+class PreparedRequest {
+public:
+  PreparedRequest() : PR_head(0), PR_tail(0), PR_error(Modbus::EMPTY_MESSAGE) {}
+  inline Error getError() const { return PR_error; }
+  inline bool isValid() const { return PR_error == Modbus::SUCCESS; }
+  // The complete frame, including header and CRC if any
+  inline const uint8_t *data() const { return PR_frame.data(); }
+  inline uint16_t size() const { return PR_frame.size(); }
+  // The request message within the frame
+  inline ModbusMessageView request() const {
+    return ModbusMessageView(PR_frame.data() + PR_head, PR_frame.size() - PR_head - PR_tail);
+  }
+
+protected:
+  ModbusMessage PR_frame;          // Frame bytes
+  uint8_t PR_head;                 // Length of the protocol header in front of the request
+  uint8_t PR_tail;                 // Length of the CRC behind the request
+  Error PR_error;                  // SUCCESS or the reason why the request could not be prepared
+
+  friend class ModbusClient;
+  friend class ModbusClientTCP;
+  friend class ModbusClientRTU;
+};
 
 class ModbusClient {
 public:
   bool onDataHandler(MBOnData handler);   // Accept onData handler 
   bool onErrorHandler(MBOnError handler); // Accept onError handler 
   bool onResponseHandler(MBOnResponse handler); // Accept onResponse handler 
+  bool onDataHandler(MBOnDataView handler);         // Accept onData handler taking a view
+  bool onResponseHandler(MBOnResponseView handler); // Accept onResponse handler taking a view
+  bool onDataHandler(std::nullptr_t) { return onDataHandler(MBOnData()); }             // Remove onData handler
+  bool onResponseHandler(std::nullptr_t) { return onResponseHandler(MBOnResponse()); } // Remove onResponse handler
   uint32_t getMessageCount();             // Informative: return number of messages created
   uint32_t getErrorCount();              // Informative: return number of errors received
   void resetCounts();                    // Set both message and error counts to zero
   inline Error addRequest(const ModbusMessage& m, uint32_t token) { return addRequestM(m, token); }
   inline ModbusMessage syncRequest(const ModbusMessage& m, uint32_t token) { return syncRequestM(m, token); }
+  inline PreparedRequest prepareRequest(const ModbusMessage& m) { return prepareRequestM(m); }
+  inline Error addRequest(const PreparedRequest& p, uint32_t token) { return addPreparedM(p, token); }
+  inline ModbusMessage syncRequest(const PreparedRequest& p, uint32_t token) { return syncPreparedM(p, token); }
+
+  // Read any number of registers (FC 0x03, 0x04) or coils (FC 0x01, 0x02). The range is split into
+  // requests of the largest size allowed, which are all queued at once. done is called once, with
+  // the data of all or the first error. If an error is returned, nothing was queued.
+  // Requests dropped by clearQueue() or end() count as TIMEOUT.
+  Error readBlock(uint8_t serverID, uint8_t functionCode, uint16_t address, uint32_t count, MBOnBlock done);
+
+#if USE_MUTEX
+  // Same, waiting for the result
+  Error readBlock(uint8_t serverID, uint8_t functionCode, uint16_t address, uint32_t count, std::vector<uint8_t>& data);
+
+  // Queue a request and get a std::future for its response. No token is needed,
+  // the response does not go through the onData/onError/onResponse handlers.
+  std::future<ModbusMessage> asyncRequest(const ModbusMessage& m);
+
+  // Template function to generate asyncRequest functions as long as there is a 
+  // matching ModbusMessage::setMessage() call
+  template <typename... Args>
+  std::future<ModbusMessage> asyncRequest(uint8_t serverID, uint8_t functionCode, Args&&... args) {
+    // Create request, if valid
+    ModbusMessage m;
+    Error rc = m.setMessage(serverID, functionCode, std::forward<Args>(args) ...);
+
+    // Queue it, if valid
+    if (rc == SUCCESS) {
+      return asyncRequest(m);
+    }
+    // Else return the error as a message
+    std::promise<ModbusMessage> p;
+    p.set_value(buildErrorMsg(rc, serverID, functionCode));
+    return p.get_future();
+  }
+#endif
+
+#if HAS_COROUTINES
+  // Awaitable for coroutines: ModbusMessage response = co_await client.awaitRequest(...);
+  // The coroutine is resumed in the client's worker task!
+  class Awaitable {
+  public:
+    Awaitable(ModbusClient& c, const ModbusMessage& m, Error e = SUCCESS) :
+      client(c),
+      request(m),
+      preset(e) {
+        if (e != SUCCESS) response.setError(m.getServerID(), m.getFunctionCode(), e);
+      }
+    bool await_ready() const noexcept { return preset != SUCCESS; }
+    bool await_suspend(std::coroutine_handle<> h) {
+      Error rc = client.addRequestD(request, [this, h](const ModbusMessage& r) {
+        response = r;
+        h.resume();
+      });
+      // Not queued? Then there is nothing to wait for.
+      if (rc != SUCCESS) {
+        response.setError(request.getServerID(), request.getFunctionCode(), rc);
+        return false;
+      }
+      return true;
+    }
+    ModbusMessage await_resume() { return response; }
+
+  protected:
+    ModbusClient& client;
+    ModbusMessage request;
+    ModbusMessage response;
+    Error preset;
+  };
+
+  inline Awaitable awaitRequest(const ModbusMessage& m) { return Awaitable(*this, m); }
+
+  // Template function to generate awaitRequest functions as long as there is a 
+  // matching ModbusMessage::setMessage() call
+  template <typename... Args>
+  Awaitable awaitRequest(uint8_t serverID, uint8_t functionCode, Args&&... args) {
+    ModbusMessage m;
+    Error rc = m.setMessage(serverID, functionCode, std::forward<Args>(args) ...);
+    if (rc == SUCCESS) {
+      return Awaitable(*this, m);
+    }
+    ModbusMessage e;
+    e.add(serverID, functionCode);
+    return Awaitable(*this, e, rc);
+  }
+#endif
+
+  // Template function to generate prepareRequest functions as long as there is a 
+  // matching ModbusMessage::setMessage() call
+  template <typename... Args>
+  PreparedRequest prepareRequest(uint8_t serverID, uint8_t functionCode, Args&&... args) {
+    // Create request, if valid
+    ModbusMessage m;
+    Error rc = m.setMessage(serverID, functionCode, std::forward<Args>(args) ...);
+
+    // Serialize it, if valid
+    if (rc == SUCCESS) {
+      return prepareRequestM(m);
+    }
+    // Else return the error, keeping server ID and function code for error responses
+    PreparedRequest p;
+    p.PR_frame.add(serverID, functionCode);
+    p.PR_error = rc;
+    return p;
+  }
 
   // Template function to generate syncRequest functions as long as there is a 
   // matching ModbusMessage::setMessage() call
@@ -92,15 +255,24 @@ protected:
   ModbusClient();             // Default constructor
   virtual ~ModbusClient();            // Destructor
   ModbusMessage waitSync(uint8_t serverID, uint8_t functionCode, uint32_t token); // wait for syncRequest response to arrive
+  void deliverSync(uint32_t token, const ModbusMessage& response); // hand a response over to the waiting syncRequest
   // Virtual addRequest variant needed internally. All others done by template!
   virtual Error addRequestM(ModbusMessage msg, uint32_t token) = 0;
   // Virtual syncRequest variant following the same pattern
   virtual ModbusMessage syncRequestM(ModbusMessage msg, uint32_t token) = 0;
+  // Variant taking a completion handler for the response. The default does not support it.
+  virtual Error addRequestD(ModbusMessage msg, MBOnDone done);
+  // Prepared request variants. The defaults serialize the plain message only.
+  virtual PreparedRequest prepareRequestM(const ModbusMessage& msg);
+  virtual Error addPreparedM(const PreparedRequest& p, uint32_t token);
+  virtual ModbusMessage syncPreparedM(const PreparedRequest& p, uint32_t token);
+  // dispatchResponse: hand an async response to the onResponse or the onData/onError handlers
+  void dispatchResponse(const ModbusMessage& response, uint32_t token, Error error);
   // Prevent copy construction or assignment
   ModbusClient(ModbusClient& other) = delete;
   ModbusClient& operator=(ModbusClient& other) = delete;
 
-  uint32_t messageCount;           // Number of requests generated. Used for transactionID in TCPhead
+  std::atomic<uint32_t> messageCount; // Number of requests generated. Used for transactionID in TCPhead
   uint32_t errorCount;             // Number of errors received
 #if HAS_FREERTOS || HAS_RP2040_FREERTOS
   TaskHandle_t worker;             // Interface instance worker task
@@ -110,12 +282,22 @@ protected:
   MBOnData onData;                 // Data response handler
   MBOnError onError;               // Error response handler
   MBOnResponse onResponse;         // Uniform response handler
+  MBOnDataView onDataView;         // Data response handler taking a view
+  MBOnResponseView onResponseView; // Uniform response handler taking a view
   static uint16_t instanceCounter; // Number of ModbusClients created
   static uint16_t instanceID;      // Next available instance number
   uint16_t myInstance;
   std::map<uint32_t, ModbusMessage> syncResponse; // Map to hold response messages on synchronous requests
 #if USE_MUTEX
-  std::mutex syncRespM;            // Mutex protecting syncResponse map against race conditions
+  // Completion slot of a syncRequest waiting for its response
+  struct SyncSlot {
+    std::condition_variable cv;    // Signalled by deliverSync()
+    ModbusMessage response;        // The response
+    bool done;                     // Response is in
+    SyncSlot() : done(false) {}
+  };
+  std::map<uint32_t, SyncSlot *> syncSlots; // Slots of the syncRequests waiting, by token
+  std::mutex syncRespM;            // Mutex protecting syncResponse and syncSlots maps against race conditions
   std::mutex countAccessM;         // Mutex protecting access to the message and error counts
 #endif
 
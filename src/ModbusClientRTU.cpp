@@ -3,8 +3,9 @@
 //               MIT license - see license.md for details
 // =================================================================================================
 #include "ModbusClientRTU.h"
+#include <algorithm>
 
-#if HAS_FREERTOS || HAS_RP2040_FREERTOS
+#if HAS_FREERTOS || HAS_RP2040_FREERTOS || IS_LINUX
 
 #undef LOCAL_LOG_LEVEL
 // #define LOCAL_LOG_LEVEL LOG_LEVEL_VERBOSE
@@ -13,14 +14,32 @@
 // Constructor takes an optional DE/RE pin and queue size
 ModbusClientRTU::ModbusClientRTU(int8_t rtsPin, uint16_t queueLimit) :
   ModbusClient(),
+  requests(queueLimit),
+  MR_clear(false),
+  MR_clearMark(0),
   MR_serial(nullptr),
   MR_lastMicros(micros()),
   MR_interval(2000),
+  MR_minInterval(2000),
   MR_rtsPin(rtsPin),
-  MR_qLimit(queueLimit),
   MR_timeoutValue(DEFAULTTIMEOUT),
   MR_useASCII(false),
-  MR_skipLeadingZeroByte(false) {
+  MR_skipLeadingZeroByte(false),
+  MR_predictLength(false),
+  MR_coalesce(false),
+  MR_maxGap(0)
+#if HAS_FREERTOS
+  , MR_hwSerial(nullptr)
+#endif
+  {
+#if IS_LINUX && !IS_RASPBERRY
+    // No GPIOs here - use a RTScallback on the serial device instead
+    if (MR_rtsPin >= 0) {
+      LOG_W("RTS pin %d not supported, use a RTS callback.\n", MR_rtsPin);
+      MR_rtsPin = -1;
+    }
+    MTRSrts = RTUutils::RTSauto;
+#else
     if (MR_rtsPin >= 0) {
       pinMode(MR_rtsPin, OUTPUT);
       MTRSrts = [this](bool level) {
@@ -30,19 +49,30 @@ ModbusClientRTU::ModbusClientRTU(int8_t rtsPin, uint16_t queueLimit) :
     } else {
       MTRSrts = RTUutils::RTSauto;
     }
+#endif
 }
 
 // Alternative constructor takes an RTS callback function
 ModbusClientRTU::ModbusClientRTU(RTScallback rts, uint16_t queueLimit) :
   ModbusClient(),
+  requests(queueLimit),
+  MR_clear(false),
+  MR_clearMark(0),
   MR_serial(nullptr),
   MR_lastMicros(micros()),
   MR_interval(2000),
+  MR_minInterval(2000),
   MTRSrts(rts),
-  MR_qLimit(queueLimit),
   MR_timeoutValue(DEFAULTTIMEOUT),
   MR_useASCII(false),
-  MR_skipLeadingZeroByte(false) {
+  MR_skipLeadingZeroByte(false),
+  MR_predictLength(false),
+  MR_coalesce(false),
+  MR_maxGap(0)
+#if HAS_FREERTOS
+  , MR_hwSerial(nullptr)
+#endif
+  {
     MR_rtsPin = -1;
     MTRSrts(LOW);
 }
@@ -66,6 +96,14 @@ void ModbusClientRTU::begin(HardwareSerial& serial, int coreID, uint32_t userInt
   uint32_t baudRate = serial.baudRate();
   serial.setRxFIFOFull(1);
   doBegin(baudRate, coreID, userInterval);
+#if HAS_FREERTOS
+  // Wake up the worker as soon as data arrives
+  MR_hwSerial = &serial;
+  serial.onReceive([this]() {
+    TaskHandle_t w = worker;
+    if (w) xTaskNotifyGive(w);
+  });
+#endif
 }
 #endif 
 
@@ -77,20 +115,31 @@ void ModbusClientRTU::doBegin(uint32_t baudRate, int coreID, uint32_t userInterv
   MTRSrts(LOW);
 
   // Set minimum interval time
-  MR_interval = RTUutils::calculateInterval(baudRate);
+  MR_minInterval = RTUutils::calculateInterval(baudRate);
+  MR_interval = MR_minInterval;
 
   // If user defined interval is longer, use that
   if (MR_interval < userInterval) {
     MR_interval = userInterval;
   }
 
+#if IS_LINUX
+  // Start thread to handle the queue
+  int rc = pthread_create(&worker, NULL, &pHandle, this);
+  if (rc) {
+    LOG_E("Error creating RTU client thread: %d\n", rc);
+    worker = 0;
+    return;
+  }
+#else
   // Create unique task name
   char taskName[18];
   snprintf(taskName, 18, "Modbus%02XRTU", myInstance);
   // Start task to handle the queue
+#endif
 #if HAS_FREERTOS
   xTaskCreatePinnedToCore((TaskFunction_t)&handleConnection, taskName, CLIENT_TASK_STACK, this, 6, &worker, coreID >= 0 ? coreID : tskNO_AFFINITY);
-#else
+#elif HAS_RP2040_FREERTOS
   xTaskCreate((TaskFunction_t)&handleConnection, taskName, CLIENT_TASK_STACK, this, 6, &worker);
   EMODBUS_SET_TASK_AFFINITY(worker, coreID);
 #endif
@@ -99,24 +148,41 @@ void ModbusClientRTU::doBegin(uint32_t baudRate, int coreID, uint32_t userInterv
 
 // end: stop worker task
 void ModbusClientRTU::end() {
+#if HAS_FREERTOS
+  // Remove the receive callback
+  if (MR_hwSerial) {
+    MR_hwSerial->onReceive(nullptr);
+    MR_hwSerial = nullptr;
+  }
+#endif
   if (worker) {
-    // Clean up queue
-    {
-      // Safely lock access
-      LOCK_GUARD(lockGuard, qLock);
-      // Get all queue entries one by one
-      while (!requests.empty()) {
-        // Remove front entry
-        requests.pop();
-      }
-    }
     // Kill task
-    vTaskDelete(worker);
-    LOG_D("Client task %d killed.\n", (uint32_t)worker);
+#if IS_LINUX
+    pthread_cancel(worker);
+    pthread_join(worker, NULL);
+    LOG_D("Client thread killed.\n");
+    worker = 0;
+#else
+    // Clear the handle first, a receive callback must not notify a deleted task
+    TaskHandle_t w = worker;
     worker = nullptr;
+    vTaskDelete(w);
+    LOG_D("Client task %d killed.\n", (uint32_t)w);
+#endif
+    // Clean up queue, including the requests the worker was busy with
+    MR_backlog.clear();
+    requests.reset(&dropped);
   }
 }
 
+#if IS_LINUX
+// pHandle: thread entry for handleConnection()
+void *ModbusClientRTU::pHandle(void *p) {
+  handleConnection(static_cast<ModbusClientRTU *>(p));
+  return nullptr;
+}
+#endif
+
 // setTimeOut: set/change the default interface timeout
 void ModbusClientRTU::setTimeout(uint32_t TOV) {
   MR_timeoutValue = TOV;
@@ -147,18 +213,30 @@ void ModbusClientRTU::skipLeading0x00(bool onOff) {
   LOG_D("Skip leading 0x00 mode = %s\n", onOff ? "ON" : "OFF");
 }
 
-// Return number of unprocessed requests in queue
+// Toggle ending responses by their expected length
+void ModbusClientRTU::predictFrameLength(bool onOff) {
+  MR_predictLength = onOff;
+  LOG_D("Predict frame length mode = %s\n", onOff ? "ON" : "OFF");
+}
+
+// Toggle merging of adjacent reads into one request
+void ModbusClientRTU::coalesceReads(bool onOff, uint16_t maxGap) {
+  MR_coalesce = onOff;
+  MR_maxGap = maxGap;
+  LOG_D("Coalesce reads mode = %s, gap %d\n", onOff ? "ON" : "OFF", maxGap);
+}
+
+// Return number of unprocessed requests
 uint32_t ModbusClientRTU::pendingRequests() {
-  return requests.size();
+  return requests.pending();
 }
 
-// Remove all pending request from queue
+// Remove all pending request from queue. The worker will drop those queued up to now.
 void ModbusClientRTU::clearQueue()
 {
-  std::queue<RequestEntry> empty;
-  LOCK_GUARD(lockGuard, qLock);
-  // Empty queue
-  std::swap(requests, empty);
+  // Requests added from now on are not affected
+  MR_clearMark = requests.mark();
+  MR_clear = true;
 }
 
 // Base addRequest taking a preformatted data buffer and length as parameters
@@ -199,6 +277,54 @@ ModbusMessage ModbusClientRTU::syncRequestM(ModbusMessage msg, uint32_t token) {
   return response;
 }
 
+// addRequestD: queue a request, answered through a completion handler
+Error ModbusClientRTU::addRequestD(ModbusMessage msg, MBOnDone done) {
+  if (!msg) return EMPTY_MESSAGE;
+  if (!addToQueue(0, msg, false, done)) return REQUEST_QUEUE_FULL;
+  return SUCCESS;
+}
+
+// prepareRequestM: serialize the request with its CRC
+PreparedRequest ModbusClientRTU::prepareRequestM(const ModbusMessage& msg) {
+  PreparedRequest p;
+  if (msg.size() >= 2) {
+    uint16_t crc16 = RTUutils::calcCRC(msg.data(), msg.size());
+    p.PR_frame.add(msg.data(), msg.size());
+    p.PR_frame.add((uint8_t)(crc16 & 0xFF), (uint8_t)((crc16 >> 8) & 0xFF));
+    p.PR_tail = 2;
+    p.PR_error = SUCCESS;
+  }
+  return p;
+}
+
+// addPreparedM: queue a prepared request
+Error ModbusClientRTU::addPreparedM(const PreparedRequest& p, uint32_t token) {
+  // Invalid or not prepared by a RTU client?
+  if (!p.isValid() || p.PR_head || p.PR_tail != 2) return ModbusClient::addPreparedM(p, token);
+
+  Error rc = SUCCESS;
+  if (!addToQueue(token, p)) {
+    rc = REQUEST_QUEUE_FULL;
+  }
+  LOG_D("RC=%02X\n", rc);
+  return rc;
+}
+
+// syncPreparedM: queue a prepared request and wait for the response
+ModbusMessage ModbusClientRTU::syncPreparedM(const PreparedRequest& p, uint32_t token) {
+  // Invalid or not prepared by a RTU client?
+  if (!p.isValid() || p.PR_head || p.PR_tail != 2) return ModbusClient::syncPreparedM(p, token);
+
+  ModbusMessageView request = p.request();
+  ModbusMessage response;
+  if (!addToQueue(token, p, true)) {
+    response.setError(request.getServerID(), request.getFunctionCode(), REQUEST_QUEUE_FULL);
+  } else {
+    response = waitSync(request.getServerID(), request.getFunctionCode(), token);
+  }
+  return response;
+}
+
 // addBroadcastMessage: create a fire-and-forget message to all servers on the RTU bus
 Error ModbusClientRTU::addBroadcastMessage(const uint8_t *data, uint8_t len) {
   Error rc = SUCCESS;        // Return value
@@ -231,27 +357,181 @@ Error ModbusClientRTU::addBroadcastMessage(const uint8_t *data, uint8_t len) {
 
 
 // addToQueue: send freshly created request to queue
-bool ModbusClientRTU::addToQueue(uint32_t token, ModbusMessage request, bool syncReq) {
+bool ModbusClientRTU::addToQueue(uint32_t token, ModbusMessage request, bool syncReq, MBOnDone done) {
   bool rc = false;
   // Did we get one?
   if (request) {
-    RequestEntry re(token, request, syncReq);
-    if (requests.size()<MR_qLimit) {
-      // Yes. Safely lock queue and push request to queue
+    // Yes. Get a free queue entry - if there is one left
+    RequestEntry *re = requests.create(token, request, syncReq);
+    if (re) {
+      re->onDone = done;
       rc = true;
-      LOCK_GUARD(lockGuard, qLock);
       requests.push(re);
     }
-    {
-      LOCK_GUARD(cntLock, countAccessM);
-      messageCount++;
-    }
+    messageCount++;
   }
 
   LOG_D("RC=%02X\n", rc);
   return rc;
 }
 
+// addToQueue: send prepared request to queue
+bool ModbusClientRTU::addToQueue(uint32_t token, const PreparedRequest& request, bool syncReq) {
+  bool rc = false;
+  // Get a free queue entry - if there is one left
+  RequestEntry *re = requests.create(token, request, syncReq);
+  if (re) {
+    rc = true;
+    requests.push(re);
+  }
+  messageCount++;
+
+  LOG_D("RC=%02X\n", rc);
+  return rc;
+}
+
+// mergeable: a read request that may be merged with others
+static bool mergeable(const ModbusMessage& msg) {
+  uint8_t fc = msg.getFunctionCode();
+  return msg.size() == 6 && msg.getServerID() != 0 && fc >= READ_COIL && fc <= READ_INPUT_REGISTER;
+}
+
+// coalesce: merge queued reads of the same server and FC into one request
+bool ModbusClientRTU::coalesce(RequestEntry *request, std::vector<RequestEntry *>& group, RequestEntry& merged) {
+  if (!mergeable(request->msg)) return false;
+
+  uint8_t serverID = request->msg.getServerID();
+  uint8_t fc = request->msg.getFunctionCode();
+  // Coils and discrete inputs may span 2000 items, registers 125
+  uint32_t limit = (fc <= READ_DISCR_INPUT) ? 2000 : 125;
+  uint16_t addr = 0;
+  uint16_t count = 0;
+  request->msg.get(2, addr, count);
+  uint32_t lo = addr;
+  uint32_t hi = (uint32_t)addr + count;
+
+  // Take all queued requests into the backlog to look at them
+  RequestEntry *re = nullptr;
+  while ((re = requests.pop()) != nullptr) {
+    MR_backlog.push_back(re);
+  }
+
+  group.push_back(request);
+  for (auto it = MR_backlog.begin(); it != MR_backlog.end();) {
+    const ModbusMessage& m = (*it)->msg;
+    // Any other request than a read ends the search - we may not reorder reads and writes
+    if (!mergeable(m)) break;
+    // Same server and FC?
+    if (m.getServerID() == serverID && m.getFunctionCode() == fc) {
+      m.get(2, addr, count);
+      uint32_t a = addr;
+      uint32_t b = (uint32_t)addr + count;
+      // Is it adjacent or close enough, and would the combined request still be allowed?
+      if (a <= hi + MR_maxGap && b + MR_maxGap >= lo && std::max(hi, b) - std::min(lo, a) <= limit) {
+        // Yes. Take it
+        lo = std::min(lo, a);
+        hi = std::max(hi, b);
+        group.push_back(*it);
+        it = MR_backlog.erase(it);
+        continue;
+      }
+    }
+    ++it;
+  }
+
+  // Nothing found?
+  if (group.size() == 1) {
+    group.clear();
+    return false;
+  }
+
+  // Build the request covering all merged ranges
+  merged.msg.setMessage(serverID, fc, lo, hi - lo);
+  return true;
+}
+
+// splitResponse: extract the response to one of the merged requests from the combined response
+static ModbusMessage splitResponse(const ModbusMessage& part, const ModbusMessage& whole, const ModbusMessage& response) {
+  ModbusMessage rv;
+  uint8_t serverID = part.getServerID();
+  uint8_t fc = part.getFunctionCode();
+
+  // An error applies to all
+  if (response.getError() != SUCCESS) {
+    rv.setError(serverID, fc, response.getError());
+    return rv;
+  }
+
+  uint16_t lo = 0;
+  uint16_t span = 0;
+  uint16_t addr = 0;
+  uint16_t count = 0;
+  whole.get(2, lo, span);
+  part.get(2, addr, count);
+  uint16_t offset = addr - lo;
+
+  // Registers?
+  if (fc >= READ_HOLD_REGISTER) {
+    // Yes. Does the byte count match the request?
+    if (response.size() < 3 || response[2] != 2 * span || response.size() != 3 + 2 * span) {
+      rv.setError(serverID, fc, PACKET_LENGTH_ERROR);
+      return rv;
+    }
+    // Yes. Cut out our registers
+    rv.add(serverID, fc, (uint8_t)(2 * count));
+    rv.add(response.data() + 3 + 2 * offset, (uint16_t)(2 * count));
+  } else {
+    // No, coils. Does the byte count match the request?
+    uint16_t bytes = (span + 7) / 8;
+    if (response.size() < 3 || response[2] != bytes || response.size() != 3 + bytes) {
+      rv.setError(serverID, fc, PACKET_LENGTH_ERROR);
+      return rv;
+    }
+    // Yes. Re-pack our bits, starting with bit 0 of the first byte
+    rv.add(serverID, fc, (uint8_t)((count + 7) / 8));
+    uint8_t byte = 0;
+    for (uint16_t i = 0; i < count; ++i) {
+      uint16_t bit = offset + i;
+      if (response[3 + bit / 8] & (1 << (bit % 8))) byte |= 1 << (i % 8);
+      if ((i % 8) == 7 || i == count - 1) {
+        rv.add(byte);
+        byte = 0;
+      }
+    }
+  }
+  return rv;
+}
+
+// respond: hand a response over to the completion handler, the waiting syncRequest or the response handlers
+void ModbusClientRTU::respond(RequestEntry& request, const ModbusMessage& response) {
+  // If we got an error, count it
+  if (response.getError() != SUCCESS) {
+    errorCount++;
+  }
+
+  // Does it have a completion handler?
+  if (request.onDone) {
+    // Yes. Call it
+    request.onDone(response);
+  // No. Is it a synchronous request?
+  } else if (request.isSyncRequest) {
+    // Yes. Hand it over to the waiting syncRequest
+    deliverSync(request.token, response);
+  // No, an async request. Hand it over to the handlers
+  } else {
+    dispatchResponse(response, request.token, response.getError());
+  }
+}
+
+// dropped: a completion handler waiting for a dropped request gets a TIMEOUT
+void ModbusClientRTU::dropped(RequestEntry *request) {
+  if (request->onDone) {
+    ModbusMessage response;
+    response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), TIMEOUT);
+    request->onDone(response);
+  }
+}
+
 // handleConnection: worker task
 // This was created in begin() to handle the queue entries
 void ModbusClientRTU::handleConnection(ModbusClientRTU *instance) {
@@ -259,17 +539,62 @@ void ModbusClientRTU::handleConnection(ModbusClientRTU *instance) {
   while (instance->MR_serial->available()) instance->MR_serial->read();
   delay(100);
 
+  // Response message, re-used for all requests
+  ModbusMessage response(256);
+  // Request covering several merged ones, re-used as well
+  RequestEntry merged(0, ModbusMessage());
+
   // Loop forever - or until task is killed
   while (1) {
-    // Do we have a reuest in queue?
-    if (!instance->requests.empty()) {
+    // Was clearQueue() called?
+    if (instance->MR_clear.exchange(false)) {
+      // Yes. Drop the requests waiting that were queued before the call
+      uint32_t mark = instance->MR_clearMark;
+      for (auto it = instance->MR_backlog.begin(); it != instance->MR_backlog.end();) {
+        if (instance->requests.before(*it, mark)) {
+          dropped(*it);
+          instance->requests.release(*it);
+          it = instance->MR_backlog.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      instance->requests.clear(mark, &dropped);
+    }
+    // Do we have a request left over from coalesce(), or one in queue?
+    RequestEntry *entry = nullptr;
+    if (!instance->MR_backlog.empty()) {
+      entry = instance->MR_backlog.front();
+      instance->MR_backlog.pop_front();
+    } else {
+      entry = instance->requests.pop();
+    }
+    if (entry) {
       // Yes. pull it.
-      RequestEntry request = instance->requests.front();
-
       LOG_D("Pulled request from queue\n");
 
-      // Send it via Serial
-      RTUutils::send(*(instance->MR_serial), instance->MR_lastMicros, instance->MR_interval, instance->MTRSrts, request.msg, instance->MR_useASCII);
+      // Original requests merged into one, if any
+      std::vector<RequestEntry *> group;
+      if (instance->MR_coalesce && instance->coalesce(entry, group, merged)) {
+        LOG_D("Merged %d requests\n", (int)group.size());
+      }
+      // The request to send: the merged or the pulled one
+      RequestEntry& request = group.empty() ? *entry : merged;
+
+      // A predicted response ended with its last byte, not after a quiet interval.
+      // Other devices may have seen that byte late, so keep another half character
+      // time (the interval is 3.5) on top of the minimum interval.
+      uint32_t interval = instance->MR_interval;
+      if (instance->MR_predictLength) {
+        interval = std::max(interval, instance->MR_minInterval + instance->MR_minInterval / 7);
+      }
+
+      // Send it via Serial. Use a precomputed CRC, if we have one
+      if (request.hasCRC && !instance->MR_useASCII) {
+        RTUutils::sendRTU(*(instance->MR_serial), instance->MR_lastMicros, interval, instance->MTRSrts, request.msg, request.CRC);
+      } else {
+        RTUutils::send(*(instance->MR_serial), instance->MR_lastMicros, interval, instance->MTRSrts, request.msg, instance->MR_useASCII);
+      }
 
       LOG_D("Request sent.\n");
       // HEXDUMP_V("Data", request.msg.data(), request.msg.size());
@@ -277,14 +602,16 @@ void ModbusClientRTU::handleConnection(ModbusClientRTU *instance) {
       // For a broadcast, we will not wait for a response
       if (request.msg.getServerID() != 0 || ((request.token & 0xFF000000) != 0xBC000000)) {
         // This is a regular request, Get the response - if any
-        ModbusMessage response = RTUutils::receive(
+        RTUutils::receive(
           'C',
           *(instance->MR_serial), 
+          response,
           instance->MR_timeoutValue, 
           instance->MR_lastMicros, 
           instance->MR_interval, 
           instance->MR_useASCII,
-          instance->MR_skipLeadingZeroByte);
+          instance->MR_skipLeadingZeroByte,
+          instance->MR_predictLength);
   
         LOG_D("%s response (%d bytes) received.\n", response.size()>1 ? "Data" : "Error", response.size());
         HEXDUMP_V("Data", response.data(), response.size());
@@ -310,49 +637,23 @@ void ModbusClientRTU::handleConnection(ModbusClientRTU *instance) {
         LOG_D("Response generated.\n");
         HEXDUMP_V("Response packet", response.data(), response.size());
 
-        // If we got an error, count it
-        if (response.getError() != SUCCESS) {
-          instance->errorCount++;
-        }
-  
-        // Was it a synchronous request?
-        if (request.isSyncRequest) {
-          // Yes. Put it into the response map
-          {
-            LOCK_GUARD(sL, instance->syncRespM);
-            instance->syncResponse[request.token] = response;
-          }
-        // No, an async request. Do we have an onResponse handler?
-        } else if (instance->onResponse) {
-          // Yes. Call it
-          instance->onResponse(response, request.token);
+        // Was it a merged request?
+        if (group.empty()) {
+          // No. Just answer it
+          instance->respond(request, response);
         } else {
-          // No, but we may have onData or onError handlers
-          // Did we get a normal response?
-          if (response.getError()==SUCCESS) {
-            // Yes. Do we have an onData handler registered?
-            if (instance->onData) {
-              // Yes. call it
-              instance->onData(response, request.token);
-            }
-          } else {
-            // No, something went wrong. All we have is an error
-            // Do we have an onError handler?
-            if (instance->onError) {
-              // Yes. Forward the error code to it
-              instance->onError(response.getError(), request.token);
-            }
+          // Yes. Give each original request its part of the response
+          for (auto r : group) {
+            instance->respond(*r, splitResponse(r->msg, request.msg, response));
           }
         }
       }
-      // Clean-up time. 
-      {
-        // Safely lock the queue
-        LOCK_GUARD(lockGuard, instance->qLock);
-        
-        // Remove the front queue entry if the queue is not empty
-        if (!instance->requests.empty()) { 
-          instance->requests.pop();
+      // Clean-up time. Give the queue entries back
+      if (group.empty()) {
+        instance->requests.release(entry);
+      } else {
+        for (auto r : group) {
+          instance->requests.release(r);
         }
       }
     } else {
@@ -7,12 +7,14 @@
 
 #include "options.h"
 
-#if HAS_FREERTOS || HAS_RP2040_FREERTOS
+#if HAS_FREERTOS || HAS_RP2040_FREERTOS || IS_LINUX
 
 #include "ModbusClient.h"
 #include "Stream.h"
 #include "RTUutils.h"
+#include "RequestQueue.h"
 #include <queue>
+#include <deque>
 #include <vector>
 
 using std::queue;
@@ -33,6 +35,9 @@ public:
   // begin: start worker task
   void begin(Stream& serial, uint32_t baudrate, int coreID = -1, uint32_t userInterval = 0);
 #if defined(ESP32) || defined(ESP8266) // Special variant for HardwareSerial
+  // ATTENTION: on FreeRTOS, this takes over the serial's onReceive() callback to wake up the
+  // worker, replacing one the application may have set. end() removes it again. It also sets
+  // setRxFIFOFull(1) so that the callback comes with each byte.
   void begin(HardwareSerial& serial, int coreID = -1, uint32_t userInterval = 0);
 #endif
   // end: stop the worker
@@ -53,7 +58,15 @@ public:
   // Toggle skipping of leading 0x00 byte
   void skipLeading0x00(bool onOff = true);
 
-  // Return number of unprocessed requests in queue
+  // Toggle ending responses by their expected length instead of waiting for the bus to be quiet.
+  // Requests then keep half a character time more than the minimum interval to the last response.
+  void predictFrameLength(bool onOff = true);
+
+  // Toggle merging of queued reads (FC 0x01..0x04) of the same server into one request, if their
+  // ranges are adjacent or at most maxGap registers/coils apart. The response is split up again.
+  void coalesceReads(bool onOff = true, uint16_t maxGap = 0);
+
+  // Return number of unprocessed requests - queued or being worked on
   uint32_t pendingRequests();
 
   // Remove all pending request from queue
@@ -67,21 +80,55 @@ protected:
     uint32_t token;
     ModbusMessage msg;
     bool isSyncRequest;
+    bool hasCRC;                // true: CRC was precomputed by prepareRequest()
+    uint16_t CRC;
+    MBOnDone onDone;            // Completion handler, if any
     RequestEntry(uint32_t t, const ModbusMessage& m, bool syncReq = false) :
       token(t),
-      msg(m),
-      isSyncRequest(syncReq) {}
+      msg(m.size() + 2),        // Keep room for the CRC behind the request
+      isSyncRequest(syncReq),
+      hasCRC(false),
+      CRC(0) {
+        msg = m;
+      }
+    RequestEntry(uint32_t t, const PreparedRequest& p, bool syncReq = false) :
+      token(t),
+      msg(p.size()),
+      isSyncRequest(syncReq),
+      hasCRC(true),
+      CRC(p.data()[p.size() - 2] | (p.data()[p.size() - 1] << 8)) {
+        msg.add(p.data(), p.size() - 2);
+      }
   };
 
   // Base addRequest and syncRequest must be present
   Error addRequestM(ModbusMessage msg, uint32_t token) override;
   ModbusMessage syncRequestM(ModbusMessage msg, uint32_t token) override;
+  Error addRequestD(ModbusMessage msg, MBOnDone done) override;
+  // Prepared requests carry the CRC
+  PreparedRequest prepareRequestM(const ModbusMessage& msg) override;
+  Error addPreparedM(const PreparedRequest& p, uint32_t token) override;
+  ModbusMessage syncPreparedM(const PreparedRequest& p, uint32_t token) override;
 
   // addToQueue: send freshly created request to queue
-  bool addToQueue(uint32_t token, ModbusMessage msg, bool syncReq = false);
+  bool addToQueue(uint32_t token, ModbusMessage msg, bool syncReq = false, MBOnDone done = nullptr);
+  bool addToQueue(uint32_t token, const PreparedRequest& request, bool syncReq = false);
+
+  // coalesce: merge queued reads of the same server and FC with the request into merged. The
+  // request and the ones merged with it are moved into group. Returns false if nothing could be merged.
+  bool coalesce(RequestEntry *request, std::vector<RequestEntry *>& group, RequestEntry& merged);
+
+  // respond: hand a response over to the completion handler, the waiting syncRequest or the response handlers
+  void respond(RequestEntry& request, const ModbusMessage& response);
+
+  // dropped: answer the completion handler of a request dropped by clearQueue() or end()
+  static void dropped(RequestEntry *request);
 
   // handleConnection: worker task method
   static void handleConnection(ModbusClientRTU *instance);
+#if IS_LINUX
+  static void *pHandle(void *p);
+#endif
 
   // receive: get response via Serial
   ModbusMessage receive(const ModbusMessage request);
@@ -89,19 +136,25 @@ protected:
   // start background task
   void doBegin(uint32_t baudRate, int coreID, uint32_t userInterval);
 
-  queue<RequestEntry> requests;   // Queue to hold requests to be processed
-  #if USE_MUTEX
-  mutex qLock;                    // Mutex to protect queue
-  #endif
+  RequestQueue<RequestEntry> requests;  // Queue to hold requests to be processed
+  std::deque<RequestEntry *> MR_backlog;  // Requests taken off the queue by coalesce(), not merged. Worker only!
+  std::atomic<bool> MR_clear;     // clearQueue() was called
+  std::atomic<uint32_t> MR_clearMark;  // Queue position clearQueue() was called at
   Stream *MR_serial;              // Ptr to the serial interface used
   unsigned long MR_lastMicros;    // Microseconds since last bus activity
   uint32_t MR_interval;           // Modbus RTU bus quiet time
+  uint32_t MR_minInterval;        // Quiet time derived from the baud rate
   int8_t MR_rtsPin;               // GPIO pin to toggle RS485 DE/RE line. -1 if none.
   RTScallback MTRSrts;            // RTS line callback function
-  uint16_t MR_qLimit;             // Maximum number of requests to hold in the queue
   uint32_t MR_timeoutValue;       // Interface default timeout
   bool MR_useASCII;               // true=ModbusASCII, false=ModbusRTU
   bool MR_skipLeadingZeroByte;    // true=skip the first byte if it is 0x00, false=accept all bytes
+  bool MR_predictLength;          // true=end frames by their expected length, false=by the interval gap only
+  bool MR_coalesce;               // true=merge adjacent reads into one request
+  uint16_t MR_maxGap;             // Number of registers/coils allowed between reads to be merged
+#if HAS_FREERTOS
+  HardwareSerial *MR_hwSerial;    // HardwareSerial notifying the worker of received data, if any
+#endif
 
 };
 
@@ -13,26 +13,38 @@
 // Constructor takes reference to Client (EthernetClient or WiFiClient)
 ModbusClientTCP::ModbusClientTCP(Client& client, uint16_t queueLimit) :
   ModbusClient(),
+  requests(queueLimit),
+  MT_clear(false),
+  MT_clearMark(0),
   MT_client(client),
   MT_lastTarget(IPAddress(0, 0, 0, 0), 0, DEFAULTTIMEOUT, TARGETHOSTINTERVAL),
   MT_target(IPAddress(0, 0, 0, 0), 0, DEFAULTTIMEOUT, TARGETHOSTINTERVAL),
   MT_defaultTimeout(DEFAULTTIMEOUT),
   MT_defaultInterval(TARGETHOSTINTERVAL),
-  MT_qLimit(queueLimit),
-  MT_timeoutsToClose(0)
-  { }
+  MT_timeoutsToClose(0),
+  MT_maxInflightRequests(1),
+  MT_idleTimeout(0),
+  MT_conn(nullptr) {
+    addClient(client);
+  }
 
 // Alternative Constructor takes reference to Client (EthernetClient or WiFiClient) plus initial target host
 ModbusClientTCP::ModbusClientTCP(Client& client, IPAddress host, uint16_t port, uint16_t queueLimit) :
   ModbusClient(),
+  requests(queueLimit),
+  MT_clear(false),
+  MT_clearMark(0),
   MT_client(client),
   MT_lastTarget(IPAddress(0, 0, 0, 0), 0, DEFAULTTIMEOUT, TARGETHOSTINTERVAL),
   MT_target(host, port, DEFAULTTIMEOUT, TARGETHOSTINTERVAL),
   MT_defaultTimeout(DEFAULTTIMEOUT),
   MT_defaultInterval(TARGETHOSTINTERVAL),
-  MT_qLimit(queueLimit),
-  MT_timeoutsToClose(0)
-  { }
+  MT_timeoutsToClose(0),
+  MT_maxInflightRequests(1),
+  MT_idleTimeout(0),
+  MT_conn(nullptr) {
+    addClient(client);
+  }
 
 // Destructor: clean up queue, task etc.
 ModbusClientTCP::~ModbusClientTCP() {
@@ -41,26 +53,25 @@ ModbusClientTCP::~ModbusClientTCP() {
 
 // end: stop worker task
 void ModbusClientTCP::end() {
-  // Clean up queue
-  {
-    // Safely lock access
-    LOCK_GUARD(lockGuard, qLock);
-    // Get all queue entries one by one
-    while (!requests.empty()) {
-      requests.pop();
-    }
-  }
   LOG_D("TCP client worker killed.\n");
   // Kill task
   if (worker) {
 #if IS_LINUX
     pthread_cancel(worker);
+    pthread_join(worker, NULL);
     worker = NULL;
 #else
     vTaskDelete(worker);
     worker = nullptr;
 #endif
   }
+  // Requests in flight will not get a response any more
+  MT_inflight.clear();
+  for (auto& c : MT_pool) {
+    c.rx.clear();
+  }
+  // Clean up queue, including the requests in flight
+  requests.reset(&dropped);
 }
 
 // begin: start worker task
@@ -112,23 +123,16 @@ bool ModbusClientTCP::setTarget(IPAddress host, uint16_t port, uint32_t timeout,
   return true;
 }
 
-// Return number of unprocessed requests in queue
+// Return number of unprocessed requests
 uint32_t ModbusClientTCP::pendingRequests() {
-  return requests.size();
+  return requests.pending();
 }
 
-// Remove all pending request from queue
+// Remove all pending request from queue. The worker will drop those queued up to now.
 void ModbusClientTCP::clearQueue() {
-  std::queue<RequestEntry *> empty;
-  LOCK_GUARD(lockGuard, qLock);
-  // Delete queue entries if still on the queue
-  while (!requests.empty()) {
-    RequestEntry *re = requests.front();
-    delete re;
-    requests.pop();
-  }
-  // Now flush the queue
-  std::swap(requests, empty);
+  // Requests added from now on are not affected
+  MT_clearMark = requests.mark();
+  MT_clear = true;
 }
 
 // Set number of timeouts to tolerate before a connection is forcibly closed.
@@ -140,6 +144,27 @@ uint8_t ModbusClientTCP::closeConnectionOnTimeouts(uint8_t n) {
   return oldValue;
 }
 
+// Set maximum number of requests sent to a target before their responses have arrived
+void ModbusClientTCP::setMaxInflightRequests(uint32_t maxInflightRequests) {
+  MT_maxInflightRequests = maxInflightRequests ? maxInflightRequests : 1;
+}
+
+// addClient: add another Client to the pool, to keep connections to more than one target open
+bool ModbusClientTCP::addClient(Client& client) {
+  if (worker) {
+    LOG_E("Clients must be added before begin()\n");
+    return false;
+  }
+  MT_pool.push_back(Connection(&client));
+  MT_conn = &MT_pool.front();
+  return true;
+}
+
+// Set idle timeout value (time before a pooled connection auto closes after being idle)
+void ModbusClientTCP::setIdleTimeout(uint32_t timeout) {
+  MT_idleTimeout = timeout;
+}
+
 // Base addRequest for preformatted ModbusMessage and last set target
 Error ModbusClientTCP::addRequestM(ModbusMessage msg, uint32_t token) {
   Error rc = SUCCESS;        // Return value
@@ -157,6 +182,13 @@ Error ModbusClientTCP::addRequestM(ModbusMessage msg, uint32_t token) {
   return rc;
 }
 
+// addRequestD: queue a request for the last set target, answered through a completion handler
+Error ModbusClientTCP::addRequestD(ModbusMessage msg, MBOnDone done) {
+  if (!msg) return EMPTY_MESSAGE;
+  if (!addToQueue(0, msg, MT_target, false, done)) return REQUEST_QUEUE_FULL;
+  return SUCCESS;
+}
+
 // TCP addRequest for preformatted ModbusMessage and adhoc target
 Error ModbusClientTCP::addRequestMT(ModbusMessage msg, uint32_t token, IPAddress targetHost, uint16_t targetPort) {
   Error rc = SUCCESS;        // Return value
@@ -216,21 +248,64 @@ ModbusMessage ModbusClientTCP::syncRequestMT(ModbusMessage msg, uint32_t token,
   return response;
 }
 
+// prepareRequestM: serialize the request with its MBAP header. The transaction ID is left 0
+PreparedRequest ModbusClientTCP::prepareRequestM(const ModbusMessage& msg) {
+  PreparedRequest p;
+  if (msg.size() >= 2) {
+    p.PR_frame.add((uint16_t)0, (uint16_t)0, (uint16_t)msg.size());
+    p.PR_frame.add(msg.data(), msg.size());
+    p.PR_head = 6;
+    p.PR_error = SUCCESS;
+  }
+  return p;
+}
+
+// addPreparedM: queue a prepared request for the last set target
+Error ModbusClientTCP::addPreparedM(const PreparedRequest& p, uint32_t token) {
+  // Invalid or not prepared by a TCP client?
+  if (!p.isValid() || p.PR_head != 6 || p.PR_tail) return ModbusClient::addPreparedM(p, token);
+
+  Error rc = SUCCESS;
+  if (!addToQueue(token, p, MT_target)) {
+    rc = REQUEST_QUEUE_FULL;
+  }
+  LOG_D("Add prepared TCP request result: %02X\n", rc);
+  return rc;
+}
+
+// syncPreparedM: queue a prepared request and wait for the response
+ModbusMessage ModbusClientTCP::syncPreparedM(const PreparedRequest& p, uint32_t token) {
+  // Invalid or not prepared by a TCP client?
+  if (!p.isValid() || p.PR_head != 6 || p.PR_tail) return ModbusClient::syncPreparedM(p, token);
+
+  ModbusMessageView request = p.request();
+  ModbusMessage response;
+  if (!addToQueue(token, p, MT_target, true)) {
+    response.setError(request.getServerID(), request.getFunctionCode(), REQUEST_QUEUE_FULL);
+  } else {
+    response = waitSync(request.getServerID(), request.getFunctionCode(), token);
+  }
+  return response;
+}
+
 // addToQueue: send freshly created request to queue
-bool ModbusClientTCP::addToQueue(uint32_t token, ModbusMessage request, TargetHost target, bool syncReq) {
+bool ModbusClientTCP::addToQueue(uint32_t token, ModbusMessage request, TargetHost target, bool syncReq, MBOnDone done) {
   bool rc = false;
   // Did we get one?
   LOG_D("Queue size: %d\n", (uint32_t)requests.size());
   HEXDUMP_D("Enqueue", request.data(), request.size());
   if (request) {
-    if (requests.size()<MT_qLimit) {
-      RequestEntry *re = new RequestEntry(token, request, target, syncReq);
+    // Get a free queue entry - if there is one left
+    RequestEntry *re = requests.create(token, request, target, syncReq);
+    if (re) {
+      re->onDone = done;
       // inject proper transactionID
       re->head.transactionID = messageCount++;
       re->head.len = request.size();
-      // Safely lock queue and push request to queue
+      // Serialize the header into the headroom
+      memcpy(re->msg.headroom(6), (const uint8_t *)re->head, 6);
+      // Push request to queue
       rc = true;
-      LOCK_GUARD(lockGuard, qLock);
       requests.push(re);
     }
   }
@@ -238,50 +313,69 @@ bool ModbusClientTCP::addToQueue(uint32_t token, ModbusMessage request, TargetHo
   return rc;
 }
 
+// addToQueue: send prepared request to queue
+bool ModbusClientTCP::addToQueue(uint32_t token, const PreparedRequest& request, TargetHost target, bool syncReq) {
+  bool rc = false;
+  LOG_D("Queue size: %d\n", (uint32_t)requests.size());
+  // Get a free queue entry - if there is one left
+  RequestEntry *re = requests.create(token, request, target, syncReq);
+  if (re) {
+    // The header is complete already, just patch in the transactionID
+    re->head.transactionID = messageCount++;
+    re->head.len = re->msg.size();
+    uint8_t *tid = re->msg.headroom(6);
+    tid[0] = (re->head.transactionID >> 8) & 0xFF;
+    tid[1] = re->head.transactionID & 0xFF;
+    // Push request to queue
+    rc = true;
+    requests.push(re);
+  }
+
+  return rc;
+}
+
 // handleConnection: worker task
 // This was created in begin() to handle the queue entries
 void ModbusClientTCP::handleConnection(ModbusClientTCP *instance) {
   bool doNotPop;
-  unsigned long lastRequest = millis();
   uint16_t timeoutCount = 0;       // Run time counter of consecutive timeouts.
 
   // Loop forever - or until task is killed
   while (1) {
-    // Do we have a request in queue?
-    if (!instance->requests.empty()) {
+    // Was clearQueue() called?
+    if (instance->MT_clear.exchange(false)) {
+      // Yes. Drop the requests not sent yet that were queued before the call
+      instance->requests.clear(instance->MT_clearMark, &dropped);
+    }
+    // Close connections nobody has used for a while
+    instance->closeIdleConnections();
+    // Pipelining requested, or are there still responses to collect from it?
+    if (instance->MT_maxInflightRequests > 1 || !instance->MT_inflight.empty()) {
+      instance->pipeline(timeoutCount);
+    // No. Do we have a request in queue?
+    } else if (instance->requests.front()) {
       // Yes. pull it.
       RequestEntry *request = instance->requests.front();
       doNotPop = false;
       LOG_D("Got request from queue\n");
 
-      // Do we have a connection open?
-      if (instance->MT_client.connected()) {
+      // Do we have a connection to the target open already?
+      Connection *conn = instance->findConnection(request->target);
+      if (conn) {
         // Empty the RX buffer in case there is a stray response left
-        while (instance->MT_client.read() != -1) {}
-        // check if lastHost/lastPort!=host/port off the queued request
-        if (instance->MT_lastTarget != request->target) {
-          // It is different. Disconnect it.
-          instance->MT_client.stop();
-          LOG_D("Target different, disconnect\n");
-          delay(1);  // Give scheduler room to breathe
-        } else {
-          // it is the same host/port.
-          // Give it some slack to get ready again
-          while (millis() - lastRequest < request->target.interval) { delay(1); }
-        }
-      }
-      // if client is disconnected (we will have to switch hosts)
-      if (!instance->MT_client.connected()) {
-        // Serial.println("Client reconnecting");
-        // It is disconnected. connect to host/port from queue
-        instance->MT_client.connect(request->target.host, request->target.port);
-        LOG_D("Target connect (%d.%d.%d.%d:%d).\n", request->target.host[0], request->target.host[1], request->target.host[2], request->target.host[3], request->target.port);
-
+        while (conn->client->read() != -1) {}
+        conn->rx.clear();
+        // Give it some slack to get ready again
+        while (millis() - conn->lastUsed < request->target.interval) { delay(1); }
+      } else {
+        // No. Take a free Client or the least recently used one and connect it
+        conn = instance->openConnection(request->target);
         delay(1);  // Give scheduler room to breathe
       }
+      instance->MT_conn = conn;
       ModbusMessage response;
       // Are we connected (again)?
-      if (instance->MT_client.connected()) {
+      if (conn->client->connected()) {
         LOG_D("Is connected. Send request.\n");
         // Yes. Send the request via IP
         instance->send(request);
@@ -294,32 +388,9 @@ void ModbusClientTCP::handleConnection(ModbusClientTCP *instance) {
           LOG_D("Data response.\n");
           // Reset timeout counter 
           timeoutCount = 0;
-          // Yes. Is it a synchronous request?
-          if (request->isSyncRequest) {
-            // Yes. Put the response into the response map
-            {
-              LOCK_GUARD(sL, instance->syncRespM);
-              instance->syncResponse[request->token] = response;
-            }
-          // No, async request. Do we have an onResponse handler?
-          } else if (instance->onResponse) {
-            // Yes. Call it.
-            instance->onResponse(response, request->token);
-          // No, but do we have an onData handler registered?
-          } else if (instance->onData) {
-            // Yes. call it
-            instance->onData(response, request->token);
-          } else {
-            LOG_D("No handler for response!\n");
-          }
         } else {
           // No, something went wrong. All we have is an error
           LOG_D("Error response.\n");
-          // Count it
-          {
-            LOCK_GUARD(responseCnt, instance->countAccessM);
-            instance->errorCount++;
-          }
           // Is it a TIMEOUT and do we need to track it?
           if (response.getError()==TIMEOUT && instance->MT_timeoutsToClose) {
             LOG_D("Checking timeout sequence\n");
@@ -330,7 +401,7 @@ void ModbusClientTCP::handleConnection(ModbusClientTCP *instance) {
               LOG_D("Timeouts: %d exceeding limit (%d), closing connection\n", 
                 timeoutCount, instance->MT_timeoutsToClose);
               // Yes. We need to cut the connection
-              instance->MT_client.stop();
+              conn->client->stop();
               delay(1);
               // reset timeout count
               timeoutCount = 0;
@@ -339,46 +410,15 @@ void ModbusClientTCP::handleConnection(ModbusClientTCP *instance) {
             // No TIMEOUT or no limit: reset timeout count
             timeoutCount = 0;
           }
-          // Is it a synchronous request?
-          if (request->isSyncRequest) {
-            // Yes. Put the response into the response map
-            {
-              LOCK_GUARD(sL, instance->syncRespM);
-              instance->syncResponse[request->token] = response;
-            }
-          // No, but do we have an onResponse handler?
-          } else if (instance->onResponse) {
-            // Yes, call it.
-            instance->onResponse(response, request->token);
-          // No, but do we have an onError handler?
-          } else if (instance->onError) {
-            // Yes. Forward the error code to it
-            instance->onError(response.getError(), request->token);
-          } else {
-            LOG_D("No onError handler\n");
-          }
         }
+        // Hand the response over
+        instance->respond(request, response);
         //   set lastHost/lastPort to host/port
         instance->MT_lastTarget = request->target;
       } else {
         // Oops. Connection failed
         response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), IP_CONNECTION_FAILED);
-        // Is it a synchronous request?
-        if (request->isSyncRequest) {
-          // Yes. Put the response into the response map
-          {
-            LOCK_GUARD(sL, instance->syncRespM);
-            instance->syncResponse[request->token] = response;
-          }
-        // No, but do we have an onResponse handler?
-        } else if (instance->onResponse) {
-          // Yes, call it.
-          instance->onResponse(response, request->token);
-        // Finally, do we have an onError handler?
-        } else if (instance->onError) {
-          // Yes. Forward the error code to it
-          instance->onError(IP_CONNECTION_FAILED, request->token);
-        }
+        instance->respond(request, response);
         // invalidate lastHost/lastPort to force a new connect
         instance->MT_lastTarget.host = IPAddress(0, 0, 0, 0);
         instance->MT_lastTarget.port = 0;
@@ -386,18 +426,12 @@ void ModbusClientTCP::handleConnection(ModbusClientTCP *instance) {
       // Clean-up time. 
       if (!doNotPop)
       {
-        // Safely lock the queue
-        LOCK_GUARD(lockGuard, instance->qLock);
-
-        // Remove the front queue entry if the queue is not empty
-        if (!instance->requests.empty()) {
-          instance->requests.pop();
-        }
-        // Delete request
-        delete request;
+        // Remove the front queue entry and give it back
+        instance->requests.pop();
+        instance->requests.release(request);
         LOG_D("Request popped from queue.\n");
       }
-      lastRequest = millis();
+      conn->lastUsed = millis();
     } else {
       delay(1);  // Give scheduler room to breathe
     }
@@ -407,63 +441,72 @@ void ModbusClientTCP::handleConnection(ModbusClientTCP *instance) {
 // send: send request via Client connection
 void ModbusClientTCP::send(RequestEntry *request) {
   // We have a established connection here, so we can write right away.
-  // Move tcpHead and request into one continuous buffer, since the very first request tends to 
-  // take too long to be sent to be recognized.
-  ModbusMessage m;
-  m.add((const uint8_t *)request->head, 6);
-  m.append(request->msg);
+  // tcpHead was put in front of the request by addToQueue() to have one continuous buffer,
+  // since the very first request tends to take too long to be sent to be recognized.
+  uint8_t *packet = request->msg.headroom(6);
+  uint16_t packetLen = request->msg.size() + 6;
 
-  MT_client.write(m.data(), m.size());
+  MT_conn->client->write(packet, packetLen);
   // Done. Are we?
-  MT_client.flush();
-  HEXDUMP_V("Request packet", m.data(), m.size());
+  MT_conn->client->flush();
+  HEXDUMP_V("Request packet", packet, packetLen);
 }
 
-// receive: get response via Client connection
+// receive: get response via Client connection. The connection's framer collects the data
+// until the MBAP header's length is complete, anything received beyond is kept for later.
 ModbusMessage ModbusClientTCP::receive(RequestEntry *request) {
   unsigned long lastMillis = millis();     // Timer to check for timeout
-  bool hadData = false;               // flag data received
-  const uint16_t dataLen(300);        // Modbus Packet supposedly will fit (260<300)
-  uint8_t data[dataLen];              // Local buffer to collect received data
-  uint16_t dataPtr = 0;               // Pointer into data
+  MBAPFramer& rx = MT_conn->rx;       // Data received on the connection
+  MBAPFramer::State state;            // Framing state of the data
   ModbusMessage response;             // Response structure to be returned
 
-  // wait for packet data, overflow or timeout
-  while (millis() - lastMillis < request->target.timeout && dataPtr < dataLen && !hadData) {
+  // wait for a complete response, a broken header or timeout
+  while ((state = rx.state()) != MBAPFramer::BROKEN) {
+    // Complete frame?
+    if (state == MBAPFramer::COMPLETE) {
+      // Yes. Is it the response to our request?
+      if (rx.transactionID() == request->head.transactionID) break;
+      // No, a late response to a request timed out already
+      LOG_W("Dropping response for unknown transactionID %04X\n", rx.transactionID());
+      rx.pop();
+      continue;
+    }
+    // Time is up?
+    if (millis() - lastMillis >= request->target.timeout) break;
     // Is there data waiting?
-    if (MT_client.available()) {
-      // Yes. catch as much as is there and fits into buffer
-      while (MT_client.available() && dataPtr < dataLen) {
-        data[dataPtr++] = MT_client.read();
-      }
-      // Register data received
-      hadData = true;
-      // Rewind EOT and timeout timers
-      lastMillis = millis();
+    int avail = MT_conn->client->available();
+    if (avail > 0) {
+      // Yes. Take as much as fits
+      uint16_t room = 0;
+      uint8_t *data = rx.space(room);
+      int got = MT_conn->client->read(data, avail < room ? avail : room);
+      if (got > 0) rx.added(got);
+    } else {
+      delay(1); // Give scheduler room to breathe
     }
-    delay(1); // Give scheduler room to breathe
   }
-  // Did we get some data?
-  if (hadData) {
+  // Did we get a complete response?
+  if (state == MBAPFramer::COMPLETE) {
+    const uint8_t *data = rx.frame();
     LOG_D("Received response.\n");
-    HEXDUMP_V("Response packet", data, dataPtr);
+    HEXDUMP_V("Response packet", data, rx.frameSize());
     // Yes. check it for validity
-    // First transactionID and protocolID shall be identical, length has to match the remainder.
-    ModbusTCPhead head(request->head.transactionID, request->head.protocolID, dataPtr - 6);
-    // Matching head?
-    if (memcmp((const uint8_t *)head, data, 6)) {
-      // No. return Error response
-      response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), TCP_HEAD_MISMATCH);
-      // If the server id does not match that of the request, report error
-    } else if (data[6] != request->msg.getServerID()) {
+    // If the server id does not match that of the request, report error
+    if (data[6] != request->msg.getServerID()) {
       response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), SERVER_ID_MISMATCH);
       // If the function code does not match that of the request, report error
     } else if ((data[7] & 0x7F) != request->msg.getFunctionCode()) {
       response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), FC_MISMATCH);
     } else {
       // Looks good.
-      response.add(data + 6, dataPtr - 6);
+      response.add(data + 6, rx.length());
     }
+    rx.pop();
+  } else if (rx.size()) {
+    // No, only a part or a broken header
+    HEXDUMP_V("Incomplete response", rx.frame(), rx.size());
+    response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), TCP_HEAD_MISMATCH);
+    rx.clear();
   } else {
     // No, timeout must have struck
     response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), TIMEOUT);
@@ -471,4 +514,230 @@ ModbusMessage ModbusClientTCP::receive(RequestEntry *request) {
   return response;
 }
 
+// pipeline: one round of the worker with more than one request in flight.
+// Requests are sent as long as the window allows and the target stays the same, responses are
+// matched to the requests in flight by their transactionID.
+void ModbusClientTCP::pipeline(uint16_t& timeoutCount) {
+  bool busy = false;
+  RequestEntry *request = nullptr;
+
+  // Send as many requests as the window allows
+  while (MT_inflight.size() < MT_maxInflightRequests && (request = requests.front()) != nullptr) {
+
+    // Another target has to wait until all responses are in
+    if (MT_conn->target != request->target || !MT_conn->client->connected()) {
+      if (!MT_inflight.empty()) break;
+      // Do we have a connection to the target open already?
+      Connection *conn = findConnection(request->target);
+      if (conn) {
+        // Empty the RX buffer in case there is a stray response left
+        while (conn->client->read() != -1) {}
+        conn->rx.clear();
+      } else {
+        // No. Take a free Client or the least recently used one and connect it
+        conn = openConnection(request->target);
+      }
+      MT_conn = conn;
+    }
+    // Give the target some slack between requests
+    if (MT_conn->client->connected() && millis() - MT_conn->lastUsed < request->target.interval) break;
+
+    // Take the request off the queue
+    requests.pop();
+    busy = true;
+    MT_conn->lastUsed = millis();
+
+    if (MT_conn->client->connected()) {
+      send(request);
+      request->sentTime = millis();
+      MT_inflight[request->head.transactionID] = request;
+      MT_lastTarget = request->target;
+      LOG_D("Request sent, %d in flight\n", (uint32_t)MT_inflight.size());
+    } else {
+      // Oops. Connection failed
+      ModbusMessage response;
+      response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), IP_CONNECTION_FAILED);
+      respond(request, response);
+      requests.release(request);
+      // invalidate lastHost/lastPort to force a new connect
+      MT_lastTarget.host = IPAddress(0, 0, 0, 0);
+      MT_lastTarget.port = 0;
+    }
+  }
+
+  // Collect whatever has arrived and cut complete responses off it
+  MBAPFramer& rx = MT_conn->rx;
+  while (1) {
+    MBAPFramer::State state;
+    while ((state = rx.state()) == MBAPFramer::COMPLETE) {
+      const uint8_t *data = rx.frame();
+      uint16_t tid = rx.transactionID();
+      HEXDUMP_V("Response packet", data, rx.frameSize());
+      auto it = MT_inflight.find(tid);
+      if (it != MT_inflight.end()) {
+        RequestEntry *request = it->second;
+        ModbusMessage response;
+        // If the server id does not match that of the request, report error
+        if (data[6] != request->msg.getServerID()) {
+          response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), SERVER_ID_MISMATCH);
+        // If the function code does not match that of the request, report error
+        } else if ((data[7] & 0x7F) != request->msg.getFunctionCode()) {
+          response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), FC_MISMATCH);
+        } else {
+          // Looks good.
+          response.add(data + 6, rx.length());
+          timeoutCount = 0;
+        }
+        respond(request, response);
+        MT_inflight.erase(it);
+        requests.release(request);
+      } else {
+        // A late response to a request timed out already
+        LOG_W("Dropping response for unknown transactionID %04X\n", tid);
+      }
+      rx.pop();
+    }
+    if (state == MBAPFramer::BROKEN) {
+      LOG_W("Invalid TCP head, dropping %d bytes\n", (uint32_t)rx.size());
+      HEXDUMP_V("Dropped", rx.frame(), rx.size());
+      rx.clear();
+    }
+    // More data waiting?
+    int avail = MT_conn->client->available();
+    if (avail <= 0) break;
+    // Yes. Take as much as fits
+    uint16_t room = 0;
+    uint8_t *data = rx.space(room);
+    int got = MT_conn->client->read(data, avail < room ? avail : room);
+    if (got <= 0) break;
+    rx.added(got);
+    busy = true;
+  }
+
+  // Check the requests in flight for timeouts
+  for (auto it = MT_inflight.begin(); it != MT_inflight.end();) {
+    RequestEntry *request = it->second;
+    if (millis() - request->sentTime >= request->target.timeout) {
+      ModbusMessage response;
+      response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), TIMEOUT);
+      respond(request, response);
+      it = MT_inflight.erase(it);
+      requests.release(request);
+      busy = true;
+      // Do we need to track it?
+      if (MT_timeoutsToClose && ++timeoutCount > MT_timeoutsToClose) {
+        LOG_D("Timeouts: %d exceeding limit (%d), closing connection\n", timeoutCount, MT_timeoutsToClose);
+        MT_conn->client->stop();
+        timeoutCount = 0;
+      }
+    } else {
+      ++it;
+    }
+  }
+
+  // Lost the connection? There will be no more responses for the requests in flight.
+  if (!MT_inflight.empty() && !MT_conn->client->connected()) {
+    LOG_D("Connection lost with %d requests in flight\n", (uint32_t)MT_inflight.size());
+    failInflight(IP_CONNECTION_FAILED);
+    rx.clear();
+    busy = true;
+  }
+
+  if (!busy) delay(1);  // Give scheduler room to breathe
+}
+
+// respond: hand a response over to the waiting syncRequest or the response handlers
+void ModbusClientTCP::respond(RequestEntry *request, ModbusMessage& response) {
+  Error e = response.getError();
+  // Count errors
+  if (e != SUCCESS) {
+    LOCK_GUARD(responseCnt, countAccessM);
+    errorCount++;
+  }
+  // Does it have a completion handler?
+  if (request->onDone) {
+    // Yes. Call it
+    request->onDone(response);
+  // No. Is it a synchronous request?
+  } else if (request->isSyncRequest) {
+    // Yes. Hand it over to the waiting syncRequest
+    deliverSync(request->token, response);
+  // No, async request. Hand it over to the handlers
+  } else {
+    dispatchResponse(response, request->token, e);
+  }
+}
+
+// failInflight: answer all requests in flight with an error
+void ModbusClientTCP::failInflight(Error e) {
+  for (auto& it : MT_inflight) {
+    RequestEntry *request = it.second;
+    ModbusMessage response;
+    response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), e);
+    respond(request, response);
+    requests.release(request);
+  }
+  MT_inflight.clear();
+}
+
+// dropped: a request dropped unanswered will not get a response. Plain requests are
+// dropped silently, but a completion handler has someone waiting for it - readBlock()
+// or asyncRequest() - so it gets a TIMEOUT.
+void ModbusClientTCP::dropped(RequestEntry *request) {
+  if (request->onDone) {
+    ModbusMessage response;
+    response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), TIMEOUT);
+    request->onDone(response);
+  }
+}
+
+// findConnection: pooled connection to the target, if there is one open
+ModbusClientTCP::Connection *ModbusClientTCP::findConnection(const TargetHost& target) {
+  for (auto& c : MT_pool) {
+    if (c.target == target && c.client->connected()) return &c;
+  }
+  return nullptr;
+}
+
+// openConnection: connect a free Client to the target. If all are busy, the least
+// recently used connection is closed for it.
+ModbusClientTCP::Connection *ModbusClientTCP::openConnection(const TargetHost& target) {
+  Connection *conn = nullptr;
+  unsigned long now = millis();
+  for (auto& c : MT_pool) {
+    if (!c.client->connected()) {
+      conn = &c;
+      break;
+    }
+    if (!conn || now - c.lastUsed > now - conn->lastUsed) conn = &c;
+  }
+  if (conn->client->connected()) {
+    LOG_D("Pool exhausted, closing connection to %d.%d.%d.%d:%d\n", conn->target.host[0], conn->target.host[1], conn->target.host[2], conn->target.host[3], conn->target.port);
+    conn->client->stop();
+  }
+  conn->client->connect(target.host, target.port);
+  conn->rx.clear();
+  LOG_D("Target connect (%d.%d.%d.%d:%d).\n", target.host[0], target.host[1], target.host[2], target.host[3], target.port);
+  conn->target = target;
+  conn->lastUsed = now - target.interval;
+  return conn;
+}
+
+// closeIdleConnections: close pooled connections idle for longer than the idle timeout
+void ModbusClientTCP::closeIdleConnections() {
+  if (!MT_idleTimeout) return;
+  unsigned long now = millis();
+  for (auto& c : MT_pool) {
+    // Responses still outstanding?
+    if (&c == MT_conn && !MT_inflight.empty()) continue;
+    if (c.target.port && now - c.lastUsed > MT_idleTimeout) {
+      if (c.client->connected()) {
+        LOG_D("Closing idle connection to %d.%d.%d.%d:%d\n", c.target.host[0], c.target.host[1], c.target.host[2], c.target.host[3], c.target.port);
+        c.client->stop();
+      }
+      c.target = TargetHost();
+    }
+  }
+}
+
 #endif
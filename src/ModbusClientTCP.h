@@ -14,8 +14,12 @@
 
 #include "ModbusClient.h"
 #include "Client.h"
+#include "RequestQueue.h"
+#include "MBAPFramer.h"
 #include <queue>
+#include <map>
 #include <vector>
+#include <cstring>
 using std::queue;
 
 #define TARGETHOSTINTERVAL 10
@@ -44,7 +48,7 @@ public:
   // Switch target host (if necessary)
   bool setTarget(IPAddress host, uint16_t port, uint32_t timeout = 0, uint32_t interval = 0);
 
-  // Return number of unprocessed requests in queue
+  // Return number of unprocessed requests - queued or in flight
   uint32_t pendingRequests();
 
   // Remove all pending request from queue
@@ -55,6 +59,19 @@ public:
   // Returns previous value.
   uint8_t closeConnectionOnTimeouts(uint8_t n=3);
 
+  // Set maximum number of requests sent to a target before their responses have arrived.
+  // 1 (default): one request at a time. Larger values need a server able to handle pipelining.
+  void setMaxInflightRequests(uint32_t maxInflightRequests);
+
+  // Add another Client to the connection pool. Each Client keeps a connection to one target open,
+  // so requests alternating between targets will not need to reconnect every time. If all are
+  // in use, the least recently used connection is closed for a new target. Call before begin().
+  bool addClient(Client& client);
+
+  // Set idle timeout value (time before a pooled connection auto closes after being idle)
+  // 0 (default): keep connections open
+  void setIdleTimeout(uint32_t timeout);
+
 protected:
   // class describing a target server
   struct TargetHost {
@@ -104,6 +121,20 @@ protected:
     }
   };
 
+  // class describing a pooled connection
+  struct Connection {
+    Client *client;             // Client used for the connection
+    TargetHost target;          // Server the Client was connected to last
+    unsigned long lastUsed;     // millis() of the last request sent
+    MBAPFramer rx;              // Received data not yet taken as a response
+
+    explicit Connection(Client *c) :
+      client(c),
+      target(TargetHost()),
+      lastUsed(0)
+    { }
+  };
+
   // class describing the TCP header of Modbus packets
   class ModbusTCPhead {
   public:
@@ -149,23 +180,48 @@ protected:
     TargetHost target;
     ModbusTCPhead head;
     bool isSyncRequest;
+    unsigned long sentTime;     // millis() when the request was sent
+    MBOnDone onDone;            // Completion handler, if any
     RequestEntry(uint32_t t, const ModbusMessage& m, TargetHost tg, bool syncReq = false) :
       token(t),
-      msg(m),
+      msg(m.size() + 6),
+      target(tg),
+      head(ModbusTCPhead()),
+      isSyncRequest(syncReq),
+      sentTime(0) {
+        // Keep room for the TCP header in front of the request
+        msg.headroom(6);
+        msg = m;
+      }
+    RequestEntry(uint32_t t, const PreparedRequest& p, TargetHost tg, bool syncReq = false) :
+      token(t),
+      msg(p.size()),
       target(tg),
       head(ModbusTCPhead()),
-      isSyncRequest(syncReq) {}
+      isSyncRequest(syncReq),
+      sentTime(0) {
+        // Take over the prepared frame: header into the headroom, request behind it
+        msg.headroom(6);
+        msg.add(p.data() + 6, p.size() - 6);
+        memcpy(msg.headroom(6), p.data(), 6);
+      }
   };
 
   // Base addRequest and syncRequest must be present
   Error addRequestM(ModbusMessage msg, uint32_t token) override;
   ModbusMessage syncRequestM(ModbusMessage msg, uint32_t token) override;
+  Error addRequestD(ModbusMessage msg, MBOnDone done) override;
   // TCP-specific addition "...MT()" including adhoc target - used by bridge 
   Error addRequestMT(ModbusMessage msg, uint32_t token, IPAddress targetHost, uint16_t targetPort);
   ModbusMessage syncRequestMT(ModbusMessage msg, uint32_t token, IPAddress targetHost, uint16_t targetPort);
+  // Prepared requests carry the complete MBAP header
+  PreparedRequest prepareRequestM(const ModbusMessage& msg) override;
+  Error addPreparedM(const PreparedRequest& p, uint32_t token) override;
+  ModbusMessage syncPreparedM(const PreparedRequest& p, uint32_t token) override;
 
   // addToQueue: send freshly created request to queue
-  bool addToQueue(uint32_t token, ModbusMessage request, TargetHost target, bool syncReq = false);
+  bool addToQueue(uint32_t token, ModbusMessage request, TargetHost target, bool syncReq = false, MBOnDone done = nullptr);
+  bool addToQueue(uint32_t token, const PreparedRequest& request, TargetHost target, bool syncReq = false);
 
   // handleConnection: worker task method
   static void handleConnection(ModbusClientTCP *instance);
@@ -179,18 +235,42 @@ protected:
   // receive: get response via Client connection
   ModbusMessage receive(RequestEntry *request);
 
-  queue<RequestEntry *> requests;   // Queue to hold requests to be processed
-  #if USE_MUTEX
-  mutex qLock;                    // Mutex to protect queue
-  #endif
+  // pipeline: one round of the worker with more than one request in flight
+  void pipeline(uint16_t& timeoutCount);
+
+  // respond: hand a response over to the waiting syncRequest or the response handlers
+  void respond(RequestEntry *request, ModbusMessage& response);
+
+  // failInflight: answer all requests in flight with an error
+  void failInflight(Error e);
+
+  // dropped: answer the completion handler of a request dropped by clearQueue() or end()
+  static void dropped(RequestEntry *request);
+
+  // findConnection: pooled connection to the target, if there is one open
+  Connection *findConnection(const TargetHost& target);
+
+  // openConnection: connect a free or the least recently used Client to the target
+  Connection *openConnection(const TargetHost& target);
+
+  // closeIdleConnections: close pooled connections idle for longer than the idle timeout
+  void closeIdleConnections();
+
+  RequestQueue<RequestEntry> requests;  // Queue to hold requests to be processed
+  std::atomic<bool> MT_clear;     // clearQueue() was called
+  std::atomic<uint32_t> MT_clearMark;  // Queue position clearQueue() was called at
   Client& MT_client;              // Client reference for Internet connections (EthernetClient or WifiClient)
   TargetHost MT_lastTarget;       // last used server
   TargetHost MT_target;           // Description of target server
   uint32_t MT_defaultTimeout;     // Standard timeout value taken if no dedicated was set
   uint32_t MT_defaultInterval;    // Standard interval value taken if no dedicated was set
-  uint16_t MT_qLimit;             // Maximum number of requests to accept in queue
   uint8_t MT_timeoutsToClose;     // 0: disregard, 1-255: number of timeouts to tolerate before
                                   //    forcibly closing a connection.
+  std::atomic<uint32_t> MT_maxInflightRequests;  // Number of requests allowed to await a response at a time. Set from any thread
+  std::map<uint16_t, RequestEntry *> MT_inflight;  // Requests sent, awaiting a response, by transactionID
+  uint32_t MT_idleTimeout;        // Time in ms before an unused pooled connection is closed, 0: never
+  std::vector<Connection> MT_pool;  // Clients available for connections, MT_client first
+  Connection *MT_conn;            // Connection currently in use
 
   // Let any ModbusBridge class use protected members
   template<typename SERVERCLASS> friend class ModbusBridge;
@@ -37,20 +37,22 @@ ModbusClientTCPasync::ModbusClientTCPasync(IPAddress address, uint16_t port, uin
 
 // Destructor: clean up queue, task etc.
 ModbusClientTCPasync::~ModbusClientTCPasync() {
-  // Clean up queue
+  // Clean up queue. The completion handlers are called without the locks held.
+  std::list<RequestEntry*> drop;
   {
     // Safely lock access
     LOCK_GUARD(lock1, qLock);
     LOCK_GUARD(lock2, sLock);
-    // Delete all elements from queues
-    while (!txQueue.empty()) {
-      delete txQueue.front();
-      txQueue.pop_front();
-    }
-    for (auto it = rxQueue.cbegin(); it != rxQueue.cend();/* no increment */) {
-      delete it->second;
-      it = rxQueue.erase(it);
+    // Take all elements from queues
+    drop.splice(drop.end(), txQueue);
+    for (auto& it : rxQueue) {
+      drop.push_back(it.second);
     }
+    rxQueue.clear();
+  }
+  for (auto r : drop) {
+    dropped(r);
+    delete r;
   }
   // force close client
   MTA_client.close(true);
@@ -100,12 +102,17 @@ void ModbusClientTCPasync::setMaxInflightRequests(uint32_t maxInflightRequests)
 // Remove all pending request from queue
 void ModbusClientTCPasync::clearQueue()
 {
-  LOCK_GUARD(lock1, qLock);
-  LOCK_GUARD(lock2, sLock);
-  // Delete all elements from queues
-  while (!txQueue.empty()) {
-    delete txQueue.front();
-    txQueue.pop_front();
+  // The completion handlers are called without the locks held
+  std::list<RequestEntry*> drop;
+  {
+    LOCK_GUARD(lock1, qLock);
+    LOCK_GUARD(lock2, sLock);
+    // Take all elements from queues
+    drop.splice(drop.end(), txQueue);
+  }
+  for (auto r : drop) {
+    dropped(r);
+    delete r;
   }
 }
 
@@ -145,8 +152,15 @@ ModbusMessage ModbusClientTCPasync::syncRequestM(ModbusMessage msg, uint32_t tok
   return response;
 }
 
+// addRequestD: queue a request, answered through a completion handler
+Error ModbusClientTCPasync::addRequestD(ModbusMessage msg, MBOnDone done) {
+  if (!msg) return EMPTY_MESSAGE;
+  if (!addToQueue(0, msg, false, done)) return REQUEST_QUEUE_FULL;
+  return SUCCESS;
+}
+
 // addToQueue: send freshly created request to queue
-bool ModbusClientTCPasync::addToQueue(int32_t token, ModbusMessage request, bool syncReq) {
+bool ModbusClientTCPasync::addToQueue(int32_t token, ModbusMessage request, bool syncReq, MBOnDone done) {
   // Did we get one?
   if (request) {
     LOCK_GUARD(lock1, qLock);
@@ -154,6 +168,7 @@ bool ModbusClientTCPasync::addToQueue(int32_t token, ModbusMessage request, bool
       HEXDUMP_V("Enqueue", request.data(), request.size());
       RequestEntry *re = new RequestEntry(token, request, syncReq);
       if (!re) return false;  //TODO: proper error returning in case allocation fails
+      re->onDone = done;
       // inject proper transactionID
       re->head.transactionID = messageCount++;
       re->head.len = request.size();
@@ -185,26 +200,26 @@ void ModbusClientTCPasync::onConnected() {
 
 void ModbusClientTCPasync::onDisconnected() {
   LOG_D("disconnected\n");
-  LOCK_GUARD(lock1, sLock);
-  MTA_state = DISCONNECTED;
-
-  // empty queue on disconnect, calling errorcode on every waiting request
-  LOCK_GUARD(lock2, qLock);
-  while (!txQueue.empty()) {
-    RequestEntry* r = txQueue.front();
-    if (onError) {
-      onError(IP_CONNECTION_FAILED, r->token);
+  // Requests to be failed. The handlers are called without the locks held,
+  // since they may add new requests.
+  std::list<RequestEntry*> failed;
+  {
+    LOCK_GUARD(lock1, sLock);
+    MTA_state = DISCONNECTED;
+
+    // empty queue on disconnect
+    LOCK_GUARD(lock2, qLock);
+    failed.splice(failed.end(), txQueue);
+    for (auto& it : rxQueue) {
+      failed.push_back(it.second);
     }
-    delete r;
-    txQueue.pop_front();
+    rxQueue.clear();
   }
-  while (!rxQueue.empty()) {
-    RequestEntry *r = rxQueue.begin()->second;
-    if (onError) {
-      onError(IP_CONNECTION_FAILED, r->token);
-    }
+
+  // call errorcode on every waiting request
+  for (auto r : failed) {
+    fail(r, IP_CONNECTION_FAILED);
     delete r;
-    rxQueue.erase(rxQueue.begin());
   }
 }
 
@@ -297,23 +312,12 @@ void ModbusClientTCPasync::onPacket(uint8_t* data, size_t length) {
         errorCount++;
       }
 
-      if (request->isSyncRequest) {
-        {
-          LOCK_GUARD(sL ,syncRespM);
-          syncResponse[request->token] = *response;
-        }
-      } else if (onResponse) {
-        onResponse(*response, request->token);
+      if (request->onDone) {
+        request->onDone(*response);
+      } else if (request->isSyncRequest) {
+        deliverSync(request->token, *response);
       } else {
-        if (error == SUCCESS) {
-          if (onData) {
-            onData(*response, request->token);
-          }
-        } else {
-          if (onError) {
-            onError(response->getError(), request->token);
-          }
-        }
+        dispatchResponse(*response, request->token, error);
       }
       delete request;
     }
@@ -327,6 +331,7 @@ void ModbusClientTCPasync::onPacket(uint8_t* data, size_t length) {
 }
 
 void ModbusClientTCPasync::onPoll() {
+  RequestEntry* timedOut = nullptr;
   {
   LOCK_GUARD(lock1, qLock);
 
@@ -338,18 +343,20 @@ void ModbusClientTCPasync::onPoll() {
     RequestEntry* request = rxQueue.begin()->second;
     if (millis() - request->sentTime > MTA_timeout) {
       LOG_D("request timeouts (now:%lu-sent:%u)\n", millis(), request->sentTime);
-      // oldest element timeouts, call onError and clean up
-      if (onError) {
-        // Handle timeout error
-        onError(TIMEOUT, request->token);
-      }
-      delete request;
+      // oldest element timeouts, take it out
+      timedOut = request;
       rxQueue.erase(rxQueue.begin());
     }
   }
     
   }  // end lockguard scope
 
+  // call onError and clean up - without the lock, the handler may add requests
+  if (timedOut) {
+    fail(timedOut, TIMEOUT);
+    delete timedOut;
+  }
+
   // if nothing happened during idle timeout, gracefully close connection
   if (millis() - MTA_lastActivity > MTA_idleTimeout) {
     disconnect();
@@ -377,6 +384,26 @@ void ModbusClientTCPasync::handleSendingQueue() {
   }
 }
 
+// fail: answer a request with an error
+void ModbusClientTCPasync::fail(RequestEntry *request, Error e) {
+  if (request->onDone) {
+    ModbusMessage response;
+    response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), e);
+    request->onDone(response);
+  } else if (onError) {
+    onError(e, request->token);
+  }
+}
+
+// dropped: a completion handler waiting for a dropped request gets a TIMEOUT
+void ModbusClientTCPasync::dropped(RequestEntry *request) {
+  if (request->onDone) {
+    ModbusMessage response;
+    response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), TIMEOUT);
+    request->onDone(response);
+  }
+}
+
 bool ModbusClientTCPasync::send(RequestEntry* re) {
   // ATTENTION: This method does not have a lock guard.
   // Calling sites must assure shared resources are protected
@@ -388,10 +415,11 @@ bool ModbusClientTCPasync::send(RequestEntry* re) {
 
   // check if TCP client is able to send
   if (MTA_client.space() > ((uint32_t)re->msg.size() + 6)) {
-    // Write TCP header first
-    MTA_client.add(reinterpret_cast<const char *>((const uint8_t *)(re->head)), 6, ASYNC_WRITE_FLAG_COPY);
-    // Request comes next
-    MTA_client.add(reinterpret_cast<const char*>(re->msg.data()), re->msg.size(), ASYNC_WRITE_FLAG_COPY);
+    // Put TCP header in front of the request
+    uint8_t *packet = re->msg.headroom(6);
+    memcpy(packet, (const uint8_t *)(re->head), 6);
+    // Write both in one go
+    MTA_client.add(reinterpret_cast<const char *>(packet), re->msg.size() + 6, ASYNC_WRITE_FLAG_COPY);
     // done
     MTA_client.send();
     LOG_D("request sent (msgid:%d)\n", re->head.transactionID);
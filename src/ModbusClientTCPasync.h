@@ -102,20 +102,32 @@ protected:
     ModbusTCPhead head;
     uint32_t sentTime;
     bool isSyncRequest;
+    MBOnDone onDone;            // Completion handler, if any
     RequestEntry(uint32_t t, const ModbusMessage& m, bool syncReq = false) :
       token(t),
-      msg(m),
+      msg(m.size() + 6),
       head(ModbusTCPhead()),
       sentTime(0),
-      isSyncRequest(syncReq) {}
+      isSyncRequest(syncReq) {
+        // Keep room for the TCP header in front of the request
+        msg.headroom(6);
+        msg = m;
+      }
   };
 
   // Base addRequest and syncRequest both must be present
   Error addRequestM(ModbusMessage msg, uint32_t token) override;
   ModbusMessage syncRequestM(ModbusMessage msg, uint32_t token) override;
+  Error addRequestD(ModbusMessage msg, MBOnDone done) override;
 
   // addToQueue: send freshly created request to queue
-  bool addToQueue(int32_t token, ModbusMessage request, bool syncReq = false);
+  bool addToQueue(int32_t token, ModbusMessage request, bool syncReq = false, MBOnDone done = nullptr);
+
+  // fail: answer a request with an error
+  void fail(RequestEntry *request, Error e);
+
+  // dropped: answer the completion handler of a request dropped by clearQueue() or the destructor
+  static void dropped(RequestEntry *request);
 
   // send: send request via Client connection
   bool send(RequestEntry *request);
@@ -0,0 +1,678 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#include "ModbusClientTCPepoll.h"
+
+#if IS_LINUX
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#undef LOCAL_LOG_LEVEL
+// #define LOCAL_LOG_LEVEL LOG_LEVEL_VERBOSE
+#include "Logging.h"
+
+// Constructor takes the maximum number of unanswered requests
+ModbusClientTCPepoll::ModbusClientTCPepoll(uint16_t queueLimit) :
+  ModbusClientTCPepoll(IPAddress(0, 0, 0, 0), 0, queueLimit) { }
+
+// Alternative Constructor takes initial target host
+ModbusClientTCPepoll::ModbusClientTCPepoll(IPAddress host, uint16_t port, uint16_t queueLimit) :
+  ModbusClient(),
+  MTE_target(host, port, EPOLL_DEFAULTTIMEOUT, EPOLL_TARGETINTERVAL),
+  MTE_defaultTimeout(EPOLL_DEFAULTTIMEOUT),
+  MTE_defaultInterval(EPOLL_TARGETINTERVAL),
+  MTE_qLimit(queueLimit),
+  MTE_pending(0),
+  MTE_timeoutsToClose(0),
+  MTE_maxInflightRequests(1),
+  MTE_idleTimeout(60000),
+  MTE_open(0),
+  MTE_clear(false),
+  MTE_stop(false) {
+    MTE_epoll = epoll_create1(EPOLL_CLOEXEC);
+    MTE_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (MTE_epoll < 0 || MTE_wakeup < 0) {
+      LOG_E("Error %d creating epoll instance\n", errno);
+    } else {
+      // The eventfd is the only one registered without a Connection
+      struct epoll_event ev;
+      ev.events = EPOLLIN;
+      ev.data.ptr = nullptr;
+      epoll_ctl(MTE_epoll, EPOLL_CTL_ADD, MTE_wakeup, &ev);
+    }
+  }
+
+// Destructor: stop worker, close connections
+ModbusClientTCPepoll::~ModbusClientTCPepoll() {
+  end();
+  if (MTE_wakeup >= 0) close(MTE_wakeup);
+  if (MTE_epoll >= 0) close(MTE_epoll);
+}
+
+// begin: start worker thread
+void ModbusClientTCPepoll::begin(int coreID) {
+  if (!worker) {
+    MTE_stop = false;
+    int rc = pthread_create(&worker, NULL, &handleConnections, this);
+    if (rc) {
+      LOG_E("Error creating TCP client thread: %d\n", rc);
+      worker = 0;
+    } else {
+      // Pin the thread to a core, if requested
+      if (coreID >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(coreID, &cpus);
+        pthread_setaffinity_np(worker, sizeof(cpus), &cpus);
+      }
+      LOG_D("TCP client worker started.\n");
+    }
+  } else {
+    LOG_E("Worker thread has been already started!");
+  }
+}
+
+// end: stop worker thread. Unanswered requests are dropped.
+void ModbusClientTCPepoll::end() {
+  // Let the worker finish its round and stop
+  if (worker) {
+    MTE_stop = true;
+    wakeup();
+    pthread_join(worker, NULL);
+    worker = 0;
+    LOG_D("TCP client worker stopped.\n");
+  }
+  // Close all connections, delete all requests
+  std::vector<RequestEntry *> drop;
+  for (auto& it : MTE_connections) {
+    Connection *conn = it.second;
+    if (conn->fd >= 0) close(conn->fd);
+    for (auto re : conn->txQueue) drop.push_back(re);
+    for (auto& re : conn->inflight) drop.push_back(re.second);
+    delete conn;
+  }
+  MTE_connections.clear();
+  MTE_open = 0;
+  {
+    LOCK_GUARD(lockGuard, qLock);
+    while (!requests.empty()) {
+      drop.push_back(requests.front());
+      requests.pop();
+    }
+  }
+  MTE_pending = 0;
+  // The completion handlers are called without the lock held
+  for (auto re : drop) {
+    dropped(re);
+    delete re;
+  }
+}
+
+// Set default timeout value (and interval)
+void ModbusClientTCPepoll::setTimeout(uint32_t timeout, uint32_t interval) {
+  MTE_defaultTimeout = timeout;
+  MTE_defaultInterval = interval;
+}
+
+// Set target for the following addRequest()/syncRequest() calls
+void ModbusClientTCPepoll::setTarget(IPAddress host, uint16_t port, uint32_t timeout, uint32_t interval) {
+  LOCK_GUARD(lockGuard, tLock);
+  MTE_target.host = host;
+  MTE_target.port = port;
+  MTE_target.timeout = timeout ? timeout : MTE_defaultTimeout;
+  MTE_target.interval = interval ? interval : MTE_defaultInterval;
+  LOG_D("Target set: %d.%d.%d.%d:%d\n", host[0], host[1], host[2], host[3], port);
+}
+
+// Return number of requests not answered yet
+uint32_t ModbusClientTCPepoll::pendingRequests() {
+  return MTE_pending;
+}
+
+// Remove all requests from the queues that have not been sent yet
+void ModbusClientTCPepoll::clearQueue() {
+  std::vector<RequestEntry *> drop;
+  {
+    LOCK_GUARD(lockGuard, qLock);
+    while (!requests.empty()) {
+      drop.push_back(requests.front());
+      requests.pop();
+      MTE_pending--;
+    }
+  }
+  // The completion handlers are called without the lock held
+  for (auto re : drop) {
+    dropped(re);
+    delete re;
+  }
+  // The connections' queues belong to the worker
+  if (worker) {
+    MTE_clear = true;
+    wakeup();
+  }
+}
+
+// Set number of consecutive timeouts on a connection before it is closed.
+uint8_t ModbusClientTCPepoll::closeConnectionOnTimeouts(uint8_t n) {
+  return MTE_timeoutsToClose.exchange(n);
+}
+
+// Set maximum number of requests sent to a target before their responses have arrived
+void ModbusClientTCPepoll::setMaxInflightRequests(uint32_t maxInflightRequests) {
+  MTE_maxInflightRequests = maxInflightRequests ? maxInflightRequests : 1;
+}
+
+// Set idle timeout value (time before a connection auto closes after being idle)
+void ModbusClientTCPepoll::setIdleTimeout(uint32_t timeout) {
+  MTE_idleTimeout = timeout;
+}
+
+// Return number of connections currently open or being opened
+uint32_t ModbusClientTCPepoll::openConnections() {
+  return MTE_open;
+}
+
+// Base addRequest for preformatted ModbusMessage and last set target
+Error ModbusClientTCPepoll::addRequestM(ModbusMessage msg, uint32_t token) {
+  TargetHost target(IPAddress(0, 0, 0, 0), 0, 0, 0);
+  {
+    LOCK_GUARD(lockGuard, tLock);
+    target = MTE_target;
+  }
+  Error rc = SUCCESS;        // Return value
+
+  // Add it to the queue, if valid
+  if (msg) {
+    // Queue add successful?
+    if (!addToQueue(token, msg, target)) {
+      // No. Return error
+      rc = REQUEST_QUEUE_FULL;
+    }
+  }
+
+  LOG_D("Add TCP request result: %02X\n", rc);
+  return rc;
+}
+
+// Base syncRequest follows the same pattern
+ModbusMessage ModbusClientTCPepoll::syncRequestM(ModbusMessage msg, uint32_t token) {
+  TargetHost target(IPAddress(0, 0, 0, 0), 0, 0, 0);
+  {
+    LOCK_GUARD(lockGuard, tLock);
+    target = MTE_target;
+  }
+  ModbusMessage response;
+
+  if (msg) {
+    // Queue add successful?
+    if (!addToQueue(token, msg, target, true)) {
+      // No. Return error
+      response.setError(msg.getServerID(), msg.getFunctionCode(), REQUEST_QUEUE_FULL);
+    } else {
+      // Request is queued - wait for the result.
+      response = waitSync(msg.getServerID(), msg.getFunctionCode(), token);
+    }
+  } else {
+    response.setError(msg.getServerID(), msg.getFunctionCode(), EMPTY_MESSAGE);
+  }
+  return response;
+}
+
+// addRequestD: queue a request for the last set target, answered through a completion handler
+Error ModbusClientTCPepoll::addRequestD(ModbusMessage msg, MBOnDone done) {
+  TargetHost target(IPAddress(0, 0, 0, 0), 0, 0, 0);
+  {
+    LOCK_GUARD(lockGuard, tLock);
+    target = MTE_target;
+  }
+  if (!msg) return EMPTY_MESSAGE;
+  if (!addToQueue(0, msg, target, false, done)) return REQUEST_QUEUE_FULL;
+  return SUCCESS;
+}
+
+// addRequest for an ad hoc target
+Error ModbusClientTCPepoll::addRequest(const ModbusMessage& m, uint32_t token, IPAddress host, uint16_t port) {
+  Error rc = SUCCESS;        // Return value
+
+  if (m.size()) {
+    TargetHost target(host, port, MTE_defaultTimeout, MTE_defaultInterval);
+    if (!addToQueue(token, m, target)) {
+      rc = REQUEST_QUEUE_FULL;
+    }
+  }
+
+  LOG_D("Add TCP request result: %02X\n", rc);
+  return rc;
+}
+
+// syncRequest for an ad hoc target
+ModbusMessage ModbusClientTCPepoll::syncRequest(const ModbusMessage& m, uint32_t token, IPAddress host, uint16_t port) {
+  ModbusMessage response;
+
+  if (m.size()) {
+    TargetHost target(host, port, MTE_defaultTimeout, MTE_defaultInterval);
+    if (!addToQueue(token, m, target, true)) {
+      response.setError(m.getServerID(), m.getFunctionCode(), REQUEST_QUEUE_FULL);
+    } else {
+      response = waitSync(m.getServerID(), m.getFunctionCode(), token);
+    }
+  } else {
+    response.setError(m.getServerID(), m.getFunctionCode(), EMPTY_MESSAGE);
+  }
+  return response;
+}
+
+// addToQueue: hand a request over to the worker
+bool ModbusClientTCPepoll::addToQueue(uint32_t token, const ModbusMessage& request, const TargetHost& target, bool syncReq, MBOnDone done) {
+  HEXDUMP_D("Enqueue", request.data(), request.size());
+  if (!request.size()) return false;
+  {
+    LOCK_GUARD(lockGuard, qLock);
+    if (MTE_pending >= MTE_qLimit) {
+      LOG_D("Request limit (%d) reached\n", MTE_qLimit);
+      return false;
+    }
+    RequestEntry *re = new RequestEntry(token, request, target, syncReq);
+    re->onDone = done;
+    // inject proper transactionID
+    re->transactionID = messageCount++;
+    requests.push(re);
+    MTE_pending++;
+  }
+  wakeup();
+  return true;
+}
+
+// wakeup: interrupt the worker's epoll_wait()
+void ModbusClientTCPepoll::wakeup() {
+  uint64_t one = 1;
+  if (write(MTE_wakeup, &one, sizeof(one)) < 0) {
+    // Counter is full - the worker will wake up anyway
+  }
+}
+
+// handleConnections: worker thread
+void *ModbusClientTCPepoll::handleConnections(void *p) {
+  ModbusClientTCPepoll *instance = static_cast<ModbusClientTCPepoll *>(p);
+  struct epoll_event events[64];
+
+  while (!instance->MTE_stop) {
+    int n = epoll_wait(instance->MTE_epoll, events, 64, EPOLL_TICK);
+    if (n < 0 && errno != EINTR) {
+      LOG_E("epoll_wait error %d\n", errno);
+      delay(EPOLL_TICK);
+    }
+    // Handle the socket events
+    for (int i = 0; i < n; ++i) {
+      Connection *conn = static_cast<Connection *>(events[i].data.ptr);
+      if (conn) {
+        instance->handleEvent(conn, events[i].events);
+      } else {
+        // New requests or a call to end() or clearQueue()
+        uint64_t count;
+        if (read(instance->MTE_wakeup, &count, sizeof(count)) < 0) { }
+      }
+    }
+    // Drop everything not sent yet?
+    if (instance->MTE_clear.exchange(false)) {
+      for (auto& it : instance->MTE_connections) {
+        for (auto re : it.second->txQueue) {
+          dropped(re);
+          delete re;
+          instance->MTE_pending--;
+        }
+        it.second->txQueue.clear();
+      }
+    }
+    instance->takeRequests();
+    // Send, check timeouts and idle connections
+    for (auto it = instance->MTE_connections.begin(); it != instance->MTE_connections.end();) {
+      Connection *conn = it->second;
+      instance->service(conn);
+      // Forget about unused targets
+      if (conn->state == Connection::DISCONNECTED && conn->txQueue.empty()) {
+        delete conn;
+        it = instance->MTE_connections.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  return nullptr;
+}
+
+// takeRequests: sort the newly queued requests into their connections' queues
+void ModbusClientTCPepoll::takeRequests() {
+  std::queue<RequestEntry *> incoming;
+  {
+    LOCK_GUARD(lockGuard, qLock);
+    std::swap(incoming, requests);
+  }
+  while (!incoming.empty()) {
+    RequestEntry *re = incoming.front();
+    incoming.pop();
+    Connection *&conn = MTE_connections[re->target.key()];
+    if (!conn) conn = new Connection(re->target);
+    conn->txQueue.push_back(re);
+  }
+}
+
+// openConnection: start a non-blocking connect to the connection's target
+void ModbusClientTCPepoll::openConnection(Connection *conn) {
+  IPAddress host = conn->target.host;
+  conn->lastActivity = millis();
+  conn->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (conn->fd < 0) {
+    LOG_E("Error %d opening socket\n", errno);
+    closeConnection(conn, IP_CONNECTION_FAILED);
+    return;
+  }
+  // Modbus requests are small - do not let Nagle hold them back
+  int one = 1;
+  setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  struct sockaddr_in server;
+  memset(&server, 0, sizeof(server));
+  server.sin_family = AF_INET;
+  server.sin_addr.s_addr = htonl((uint32_t)host);
+  server.sin_port = htons(conn->target.port);
+
+  int rc = connect(conn->fd, (struct sockaddr *)&server, sizeof(server));
+  if (rc < 0 && errno != EINPROGRESS) {
+    LOG_E("Error %d connecting to %d.%d.%d.%d:%d\n", errno, host[0], host[1], host[2], host[3], conn->target.port);
+    closeConnection(conn, IP_CONNECTION_FAILED);
+    return;
+  }
+  LOG_D("Target connect (%d.%d.%d.%d:%d).\n", host[0], host[1], host[2], host[3], conn->target.port);
+  conn->state = rc ? Connection::CONNECTING : Connection::CONNECTED;
+  MTE_open++;
+  watch(conn);
+}
+
+// closeConnection: close the socket and answer all requests in flight with an error.
+// If the connection could not be established, the requests waiting for it are answered as well.
+void ModbusClientTCPepoll::closeConnection(Connection *conn, Error e) {
+  bool failed = conn->state != Connection::CONNECTED;
+  if (conn->fd >= 0) {
+    // close() takes the socket out of the epoll set as well
+    close(conn->fd);
+    conn->fd = -1;
+    if (conn->state != Connection::DISCONNECTED) MTE_open--;
+  }
+  conn->state = Connection::DISCONNECTED;
+  conn->events = 0;
+  conn->rx.clear();
+  conn->txBuffer.clear();
+  conn->timeoutCount = 0;
+  for (auto& it : conn->inflight) {
+    fail(it.second, e);
+  }
+  conn->inflight.clear();
+  if (failed) {
+    for (auto re : conn->txQueue) {
+      fail(re, e);
+    }
+    conn->txQueue.clear();
+  }
+}
+
+// handleEvent: deal with the events epoll reported for a connection
+void ModbusClientTCPepoll::handleEvent(Connection *conn, uint32_t events) {
+  if (conn->state == Connection::CONNECTING) {
+    // The connect has finished - successfully?
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+      IPAddress host = conn->target.host;
+      LOG_E("Error %d connecting to %d.%d.%d.%d:%d\n", err, host[0], host[1], host[2], host[3], conn->target.port);
+      closeConnection(conn, IP_CONNECTION_FAILED);
+      return;
+    }
+    LOG_D("Connected.\n");
+    conn->state = Connection::CONNECTED;
+    conn->lastActivity = millis();
+    watch(conn);
+    return;
+  }
+  if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+    if (!receive(conn)) {
+      closeConnection(conn, IP_CONNECTION_FAILED);
+      return;
+    }
+  }
+  if (events & EPOLLOUT) {
+    if (!flush(conn)) {
+      closeConnection(conn, IP_CONNECTION_FAILED);
+      return;
+    }
+  }
+}
+
+// receive: read whatever has arrived and match complete responses to the requests in flight
+// Returns false if the connection was lost.
+bool ModbusClientTCPepoll::receive(Connection *conn) {
+  // Read until the socket is empty
+  while (1) {
+    // Cut complete responses off the data received so far
+    MBAPFramer::State state;
+    while ((state = conn->rx.state()) == MBAPFramer::COMPLETE) {
+      const uint8_t *data = conn->rx.frame();
+      uint16_t tid = conn->rx.transactionID();
+      HEXDUMP_V("Response packet", data, conn->rx.frameSize());
+      auto it = conn->inflight.find(tid);
+      if (it != conn->inflight.end()) {
+        RequestEntry *request = it->second;
+        ModbusMessage response;
+        // If the server id does not match that of the request, report error
+        if (data[6] != request->msg.getServerID()) {
+          response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), SERVER_ID_MISMATCH);
+        // If the function code does not match that of the request, report error
+        } else if ((data[7] & 0x7F) != request->msg.getFunctionCode()) {
+          response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), FC_MISMATCH);
+        } else {
+          // Looks good.
+          response.add(data + 6, conn->rx.length());
+          conn->timeoutCount = 0;
+        }
+        conn->inflight.erase(it);
+        respond(request, response);
+      } else {
+        // A late response to a request timed out already
+        LOG_W("Dropping response for unknown transactionID %04X\n", tid);
+      }
+      conn->rx.pop();
+    }
+    if (state == MBAPFramer::BROKEN) {
+      LOG_W("Invalid TCP head, dropping %d bytes\n", (uint32_t)conn->rx.size());
+      HEXDUMP_V("Dropped", conn->rx.frame(), conn->rx.size());
+      conn->rx.clear();
+    }
+
+    // Get more data, as much as fits
+    uint16_t room = 0;
+    uint8_t *data = conn->rx.space(room);
+    ssize_t got = recv(conn->fd, data, room, 0);
+    if (got > 0) {
+      conn->rx.added(got);
+      conn->lastActivity = millis();
+      continue;
+    }
+    if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    if (got < 0 && errno == EINTR) continue;
+    // Closed by the server or error
+    LOG_D("Connection lost with %d requests in flight\n", (uint32_t)conn->inflight.size());
+    return false;
+  }
+  return true;
+}
+
+// flush: write as much of the unsent data as the socket will take
+// Returns false if the connection was lost.
+bool ModbusClientTCPepoll::flush(Connection *conn) {
+  if (!conn->txBuffer.empty()) {
+    ssize_t sent = send(conn->fd, conn->txBuffer.data(), conn->txBuffer.size(), MSG_NOSIGNAL);
+    if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      LOG_E("Error %d sending\n", errno);
+      return false;
+    }
+    if (sent > 0) conn->txBuffer.erase(conn->txBuffer.begin(), conn->txBuffer.begin() + sent);
+  }
+  watch(conn);
+  return true;
+}
+
+// service: send requests, check timeouts and idle time of a connection
+void ModbusClientTCPepoll::service(Connection *conn) {
+  unsigned long now = millis();
+
+  switch (conn->state) {
+  case Connection::DISCONNECTED:
+    // Anything to send? Then connect.
+    if (!conn->txQueue.empty()) openConnection(conn);
+    return;
+  case Connection::CONNECTING:
+    // Connect taking too long?
+    if (now - conn->lastActivity >= conn->target.timeout) {
+      IPAddress host = conn->target.host;
+      LOG_W("Timeout connecting to %d.%d.%d.%d:%d\n", host[0], host[1], host[2], host[3], conn->target.port);
+      closeConnection(conn, IP_CONNECTION_FAILED);
+    }
+    return;
+  case Connection::CONNECTED:
+    break;
+  }
+
+  // Send as many requests as the window and the interval allow
+  while (!conn->txQueue.empty()
+      && conn->inflight.size() < MTE_maxInflightRequests
+      && conn->txBuffer.empty()) {
+    RequestEntry *request = conn->txQueue.front();
+    if (now - conn->lastSent < request->target.interval) break;
+    conn->txQueue.pop_front();
+
+    // Put the TCP header in front of the request
+    uint8_t *packet = request->msg.headroom(6);
+    uint16_t packetLen = request->msg.size() + 6;
+    packet[0] = (request->transactionID >> 8) & 0xFF;
+    packet[1] = request->transactionID & 0xFF;
+    packet[2] = 0;
+    packet[3] = 0;
+    packet[4] = (request->msg.size() >> 8) & 0xFF;
+    packet[5] = request->msg.size() & 0xFF;
+    HEXDUMP_V("Request packet", packet, packetLen);
+
+    // Keep what the socket would not take for the next EPOLLOUT
+    ssize_t sent = send(conn->fd, packet, packetLen, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        LOG_E("Error %d sending\n", errno);
+        conn->txQueue.push_front(request);
+        closeConnection(conn, IP_CONNECTION_FAILED);
+        return;
+      }
+      sent = 0;
+    }
+    if (sent < packetLen) {
+      conn->txBuffer.insert(conn->txBuffer.end(), packet + sent, packet + packetLen);
+      watch(conn);
+    }
+    request->sentTime = now;
+    conn->lastSent = now;
+    conn->lastActivity = now;
+    conn->inflight[request->transactionID] = request;
+  }
+
+  // Check the requests in flight for timeouts
+  for (auto it = conn->inflight.begin(); it != conn->inflight.end();) {
+    RequestEntry *request = it->second;
+    if (now - request->sentTime >= request->target.timeout) {
+      it = conn->inflight.erase(it);
+      fail(request, TIMEOUT);
+      // Do we need to track it?
+      if (MTE_timeoutsToClose && ++conn->timeoutCount > MTE_timeoutsToClose) {
+        LOG_D("Timeouts: %d exceeding limit (%d), closing connection\n", conn->timeoutCount, (uint32_t)MTE_timeoutsToClose);
+        closeConnection(conn, TIMEOUT);
+        return;
+      }
+    } else {
+      ++it;
+    }
+  }
+
+  // Idle for too long?
+  if (MTE_idleTimeout && conn->inflight.empty() && conn->txQueue.empty()
+   && now - conn->lastActivity > MTE_idleTimeout) {
+    IPAddress host = conn->target.host;
+    LOG_D("Closing idle connection to %d.%d.%d.%d:%d\n", host[0], host[1], host[2], host[3], conn->target.port);
+    closeConnection(conn, IP_CONNECTION_FAILED);
+  }
+}
+
+// watch: set the events epoll is to report for a connection
+void ModbusClientTCPepoll::watch(Connection *conn) {
+  // A pending connect is signalled by EPOLLOUT. Once connected, we need it only while data is waiting.
+  uint32_t events = EPOLLOUT;
+  if (conn->state == Connection::CONNECTED) {
+    events = conn->txBuffer.empty() ? EPOLLIN : (EPOLLIN | EPOLLOUT);
+  }
+  if (events == conn->events) return;
+
+  struct epoll_event ev;
+  ev.events = events;
+  ev.data.ptr = conn;
+  if (epoll_ctl(MTE_epoll, conn->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, conn->fd, &ev) < 0) {
+    LOG_E("epoll_ctl error %d\n", errno);
+  }
+  conn->events = events;
+}
+
+// respond: hand a response over to the waiting syncRequest or the response handlers
+void ModbusClientTCPepoll::respond(RequestEntry *request, const ModbusMessage& response) {
+  Error e = response.getError();
+  // Count errors
+  if (e != SUCCESS) {
+    LOCK_GUARD(responseCnt, countAccessM);
+    errorCount++;
+  }
+  // Does it have a completion handler?
+  if (request->onDone) {
+    // Yes. Call it
+    request->onDone(response);
+  // No. Is it a synchronous request?
+  } else if (request->isSyncRequest) {
+    // Yes. Hand it over to the waiting syncRequest
+    deliverSync(request->token, response);
+  // No, async request. Hand it over to the handlers
+  } else {
+    dispatchResponse(response, request->token, e);
+  }
+  delete request;
+  MTE_pending--;
+}
+
+// fail: answer a request with an error
+void ModbusClientTCPepoll::fail(RequestEntry *request, Error e) {
+  ModbusMessage response;
+  response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), e);
+  respond(request, response);
+}
+
+// dropped: a completion handler waiting for a dropped request gets a TIMEOUT
+void ModbusClientTCPepoll::dropped(RequestEntry *request) {
+  if (request->onDone) {
+    ModbusMessage response;
+    response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), TIMEOUT);
+    request->onDone(response);
+  }
+}
+
+#endif  // IS_LINUX
@@ -0,0 +1,218 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _MODBUS_CLIENT_TCP_EPOLL_H
+#define _MODBUS_CLIENT_TCP_EPOLL_H
+#include "options.h"
+
+#if IS_LINUX
+#include "ModbusMessage.h"
+#include "ModbusClient.h"
+#include "IPAddress.h"
+#include "MBAPFramer.h"
+#include <atomic>
+#include <list>
+#include <map>
+#include <queue>
+#include <vector>
+
+#define EPOLL_DEFAULTTIMEOUT 2000
+#define EPOLL_TARGETINTERVAL 0
+#define EPOLL_TICK 10
+
+// ModbusClientTCPepoll: one worker thread serving any number of TCP targets at once.
+// All connections are non-blocking sockets watched by a single epoll instance, each
+// target may have several requests in flight. Linux only.
+class ModbusClientTCPepoll : public ModbusClient {
+public:
+  // Constructor takes the maximum number of unanswered requests
+  explicit ModbusClientTCPepoll(uint16_t queueLimit = 1000);
+
+  // Alternative Constructor takes initial target host
+  ModbusClientTCPepoll(IPAddress host, uint16_t port, uint16_t queueLimit = 1000);
+
+  // Destructor: stop worker, close connections
+  ~ModbusClientTCPepoll();
+
+  // begin: start worker thread
+  void begin(int coreID = -1);
+
+  // end: stop worker thread. Unanswered requests are dropped.
+  void end();
+
+  // Set default timeout value (and interval)
+  void setTimeout(uint32_t timeout = EPOLL_DEFAULTTIMEOUT, uint32_t interval = EPOLL_TARGETINTERVAL);
+
+  // Set target for the following addRequest()/syncRequest() calls
+  void setTarget(IPAddress host, uint16_t port, uint32_t timeout = 0, uint32_t interval = 0);
+
+  // Queue requests for the given target instead of the one set by setTarget().
+  // Safe to call from any number of threads at the same time.
+  Error addRequest(const ModbusMessage& m, uint32_t token, IPAddress host, uint16_t port);
+  ModbusMessage syncRequest(const ModbusMessage& m, uint32_t token, IPAddress host, uint16_t port);
+  using ModbusClient::addRequest;
+  using ModbusClient::syncRequest;
+
+  // Return number of requests not answered yet
+  uint32_t pendingRequests();
+
+  // Remove all requests from the queues that have not been sent yet
+  void clearQueue();
+
+  // Set number of consecutive timeouts on a connection before it is closed.
+  // 0: never, 1..255: desired number
+  // Returns previous value.
+  uint8_t closeConnectionOnTimeouts(uint8_t n = 3);
+
+  // Set maximum number of requests sent to a target before their responses have arrived.
+  // 1 (default): one request at a time. Larger values need a server able to handle pipelining.
+  void setMaxInflightRequests(uint32_t maxInflightRequests);
+
+  // Set idle timeout value (time before a connection auto closes after being idle)
+  // 0: keep connections open
+  void setIdleTimeout(uint32_t timeout);
+
+  // Return number of connections currently open or being opened
+  uint32_t openConnections();
+
+protected:
+  // class describing a target server
+  struct TargetHost {
+    IPAddress     host;         // IP address
+    uint16_t      port;         // Port number
+    uint32_t      timeout;      // Time in ms waiting for a connect or a response
+    uint32_t      interval;     // Time in ms to wait between requests
+
+    TargetHost(IPAddress h, uint16_t p, uint32_t t, uint32_t i) :
+      host(h),
+      port(p),
+      timeout(t),
+      interval(i)
+    { }
+
+    // key: host and port combined to find the connection
+    inline uint64_t key() const {
+      IPAddress h = host;
+      return ((uint64_t)(uint32_t)h << 16) | port;
+    }
+  };
+
+  struct RequestEntry {
+    uint32_t token;
+    ModbusMessage msg;
+    TargetHost target;
+    uint16_t transactionID;
+    bool isSyncRequest;
+    unsigned long sentTime;     // millis() when the request was sent
+    MBOnDone onDone;            // Completion handler, if any
+    RequestEntry(uint32_t t, const ModbusMessage& m, const TargetHost& tg, bool syncReq = false) :
+      token(t),
+      msg(m.size() + 6),
+      target(tg),
+      transactionID(0),
+      isSyncRequest(syncReq),
+      sentTime(0) {
+        // Keep room for the TCP header in front of the request
+        msg.headroom(6);
+        msg = m;
+      }
+  };
+
+  // class describing the connection to one target
+  struct Connection {
+    int fd;                     // Socket, -1 if closed
+    TargetHost target;          // Server connected to
+    enum {
+      DISCONNECTED,
+      CONNECTING,
+      CONNECTED
+    } state;                    // TCP connection state
+    std::list<RequestEntry *> txQueue;             // Requests waiting to be sent
+    std::map<uint16_t, RequestEntry *> inflight;   // Requests sent, awaiting a response, by transactionID
+    MBAPFramer rx;              // Received data not yet matched to a request in flight
+    std::vector<uint8_t> txBuffer;  // Data the socket did not take yet
+    uint32_t events;            // Events epoll is watching for
+    unsigned long lastActivity; // millis() of the last connect, send or receive
+    unsigned long lastSent;     // millis() of the last request sent
+    uint16_t timeoutCount;      // Number of consecutive timeouts
+
+    explicit Connection(const TargetHost& t) :
+      fd(-1),
+      target(t),
+      state(DISCONNECTED),
+      events(0),
+      lastActivity(0),
+      lastSent(0),
+      timeoutCount(0)
+    { }
+  };
+
+  // Base addRequest and syncRequest must be present
+  Error addRequestM(ModbusMessage msg, uint32_t token) override;
+  ModbusMessage syncRequestM(ModbusMessage msg, uint32_t token) override;
+  Error addRequestD(ModbusMessage msg, MBOnDone done) override;
+
+  // addToQueue: hand a request over to the worker
+  bool addToQueue(uint32_t token, const ModbusMessage& request, const TargetHost& target, bool syncReq = false, MBOnDone done = nullptr);
+
+  // handleConnections: worker thread
+  static void *handleConnections(void *p);
+
+  // takeRequests: sort the newly queued requests into their connections' queues
+  void takeRequests();
+
+  // openConnection: start a non-blocking connect to the connection's target
+  void openConnection(Connection *conn);
+
+  // closeConnection: close the socket and answer all requests in flight with an error
+  void closeConnection(Connection *conn, Error e);
+
+  // handleEvent: deal with the events epoll reported for a connection
+  void handleEvent(Connection *conn, uint32_t events);
+
+  // receive: read whatever has arrived and match complete responses to the requests in flight
+  bool receive(Connection *conn);
+
+  // flush: write as much of the unsent data as the socket will take
+  bool flush(Connection *conn);
+
+  // service: send requests, check timeouts and idle time of a connection
+  void service(Connection *conn);
+
+  // watch: set the events epoll is to report for a connection
+  void watch(Connection *conn);
+
+  // respond: hand a response over to the waiting syncRequest or the response handlers
+  void respond(RequestEntry *request, const ModbusMessage& response);
+
+  // fail: answer a request with an error
+  void fail(RequestEntry *request, Error e);
+
+  // dropped: answer the completion handler of a request dropped by clearQueue() or end()
+  static void dropped(RequestEntry *request);
+
+  // wakeup: interrupt the worker's epoll_wait()
+  void wakeup();
+
+  std::queue<RequestEntry *> requests;   // Requests queued, not yet taken by the worker
+  std::mutex qLock;                       // Mutex to protect queue
+  std::mutex tLock;                       // Mutex to protect MTE_target
+  std::map<uint64_t, Connection *> MTE_connections;  // All targets known, by host and port
+  TargetHost MTE_target;            // Target set by setTarget()
+  uint32_t MTE_defaultTimeout;      // Standard timeout value taken if no dedicated was set
+  uint32_t MTE_defaultInterval;     // Standard interval value taken if no dedicated was set
+  uint16_t MTE_qLimit;              // Maximum number of unanswered requests
+  std::atomic<uint32_t> MTE_pending;        // Number of unanswered requests
+  std::atomic<uint8_t> MTE_timeoutsToClose; // 0: disabled, 1..255: number of timeouts to close a connection
+  std::atomic<uint32_t> MTE_maxInflightRequests;  // Number of requests allowed to await a response per target
+  std::atomic<uint32_t> MTE_idleTimeout;    // Time in ms before an unused connection is closed, 0: never
+  std::atomic<uint32_t> MTE_open;           // Number of connections open or being opened
+  std::atomic<bool> MTE_clear;      // clearQueue() was called
+  std::atomic<bool> MTE_stop;       // end() was called
+  int MTE_epoll;                    // epoll instance
+  int MTE_wakeup;                   // eventfd to interrupt epoll_wait()
+};
+
+#endif  // IS_LINUX
+#endif  // _MODBUS_CLIENT_TCP_EPOLL_H
@@ -7,15 +7,442 @@
 // #define LOCAL_LOG_LEVEL LOG_LEVEL_ERROR
 #include "Logging.h"
 #include <algorithm>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// hostMask: byte re-ordering between MSB-first (Modbus) and native integers of size bytes
+static constexpr uint8_t hostMask(uint8_t size) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return 0;
+#else
+  return size - 1;
+#endif
+}
+
+// swapBlock: copy len bytes from src to dst, taking byte i from src[i ^ mask].
+// For values of 2, 4 or 8 bytes a mask below the value size re-orders the bytes within each value,
+// f.i. 1 swaps the bytes of 16 bit values, 3 reverses 32 bit values and 2 swaps their registers.
+// The swapTables permutations are of exactly that form. If nibbles is set, nibbles are swapped as well.
+// Blocks of 16 (or 32) bytes are done with SIMD instructions where available.
+static void swapBlock(uint8_t *dst, const uint8_t *src, uint16_t len, uint8_t mask, bool nibbles) {
+  uint16_t i = 0;
+#if defined(__SSSE3__) || (defined(__ARM_NEON) && defined(__aarch64__))
+  // Shuffle pattern for the byte shuffle instructions
+  uint8_t pattern[32];
+  for (uint8_t j = 0; j < 32; ++j) pattern[j] = j ^ mask;
+#endif
+#if defined(__AVX2__)
+  {
+    const __m256i shuffle = _mm256_loadu_si256((const __m256i *)pattern);
+    const __m256i low = _mm256_set1_epi8(0x0F);
+    for (; i + 32 <= len; i += 32) {
+      __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + i)), shuffle);
+      if (nibbles) {
+        v = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(v, low), 4), _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+      }
+      _mm256_storeu_si256((__m256i *)(dst + i), v);
+    }
+  }
+#endif
+#if defined(__SSE2__)
+  {
+#if defined(__SSSE3__)
+    const __m128i shuffle = _mm_loadu_si128((const __m128i *)pattern);
+#endif
+    const __m128i low = _mm_set1_epi8(0x0F);
+    for (; i + 16 <= len; i += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+#if defined(__SSSE3__)
+      v = _mm_shuffle_epi8(v, shuffle);
+#else
+      // No byte shuffle with plain SSE2 - compose the mask from byte, register and word swaps
+      if (mask & 0x01) v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+      if (mask & 0x02) v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);
+      if (mask & 0x04) v = _mm_shuffle_epi32(v, 0xB1);
+#endif
+      if (nibbles) {
+        v = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, low), 4), _mm_and_si128(_mm_srli_epi16(v, 4), low));
+      }
+      _mm_storeu_si128((__m128i *)(dst + i), v);
+    }
+  }
+#elif defined(__ARM_NEON)
+  {
+#if defined(__aarch64__)
+    const uint8x16_t shuffle = vld1q_u8(pattern);
+#endif
+    for (; i + 16 <= len; i += 16) {
+      uint8x16_t v = vld1q_u8(src + i);
+#if defined(__aarch64__)
+      v = vqtbl1q_u8(v, shuffle);
+#else
+      // No 16 byte table lookup on ARMv7 - compose the mask from byte, register and word swaps
+      if (mask & 0x01) v = vrev16q_u8(v);
+      if (mask & 0x02) v = vreinterpretq_u8_u16(vrev32q_u16(vreinterpretq_u16_u8(v)));
+      if (mask & 0x04) v = vreinterpretq_u8_u32(vrev64q_u32(vreinterpretq_u32_u8(v)));
+#endif
+      if (nibbles) {
+        v = vorrq_u8(vshlq_n_u8(v, 4), vshrq_n_u8(v, 4));
+      }
+      vst1q_u8(dst + i, v);
+    }
+  }
+#endif
+  // Scalar code for the remainder (or all of it without SIMD support)
+  if (nibbles) {
+    for (; i < len; ++i) {
+      uint8_t b = src[i ^ mask];
+      dst[i] = ((b & 0x0F) << 4) | ((b >> 4) & 0x0F);
+    }
+  } else {
+    for (; i < len; ++i) {
+      dst[i] = src[i ^ mask];
+    }
+  }
+}
+
+// MessageBuffer: default constructor - start empty with the inline storage (if any)
+MessageBuffer::MessageBuffer() :
+  MB_buffer(inlineBuffer()),
+  MB_capacity(MM_INLINE_SIZE),
+  MB_head(0),
+  MB_size(0) { }
+
+// MessageBuffer: constructor taking a block of bytes to copy
+MessageBuffer::MessageBuffer(const uint8_t *data, uint32_t len) :
+  MB_buffer(inlineBuffer()),
+  MB_capacity(MM_INLINE_SIZE),
+  MB_head(0),
+  MB_size(0) {
+  append(data, len);
+}
+
+// MessageBuffer: copy constructor
+MessageBuffer::MessageBuffer(const MessageBuffer& b) :
+  MB_buffer(inlineBuffer()),
+  MB_capacity(MM_INLINE_SIZE),
+  MB_head(0),
+  MB_size(0) {
+  append(b.data(), b.MB_size);
+}
+
+// MessageBuffer: assignment - re-uses the existing storage and headroom if large enough
+MessageBuffer& MessageBuffer::operator=(const MessageBuffer& b) {
+  if (this != &b) {
+    MB_size = 0;
+    append(b.data(), b.MB_size);
+  }
+  return *this;
+}
+
+#ifndef NO_MOVE
+// MessageBuffer: move constructor - takes over a heap block, copies inline data
+MessageBuffer::MessageBuffer(MessageBuffer&& b) :
+  MB_buffer(inlineBuffer()),
+  MB_capacity(MM_INLINE_SIZE),
+  MB_head(0),
+  MB_size(0) {
+  *this = std::move(b);
+}
+
+// MessageBuffer: move assignment
+MessageBuffer& MessageBuffer::operator=(MessageBuffer&& b) {
+  if (this != &b) {
+    // Is the source holding a heap block?
+    if (b.onHeap()) {
+      // Yes. Release our own heap block, if any, and take over the source's
+      if (onHeap()) delete[] MB_buffer;
+      MB_buffer = b.MB_buffer;
+      MB_capacity = b.MB_capacity;
+      MB_head = b.MB_head;
+      MB_size = b.MB_size;
+      // Source falls back to its inline buffer
+      b.MB_buffer = b.inlineBuffer();
+      b.MB_capacity = MM_INLINE_SIZE;
+      b.MB_head = 0;
+    } else {
+      // No, source data is inline. We will have to copy it.
+      MB_size = 0;
+      append(b.data(), b.MB_size);
+    }
+    b.MB_size = 0;
+  }
+  return *this;
+}
+#endif
+
+// MessageBuffer: destructor - release heap block, if any
+MessageBuffer::~MessageBuffer() {
+  if (onHeap()) delete[] MB_buffer;
+}
+
+// reallocate: move data into storage of (at least) cap bytes with headLen bytes headroom.
+// Callers have to make sure cap does not exceed MM_MAXSIZE and will hold headLen + MB_size bytes.
+void MessageBuffer::reallocate(uint32_t cap, uint16_t headLen) {
+  uint8_t *block = inlineBuffer();
+  // Will it fit into the inline storage?
+  if (cap <= MM_INLINE_SIZE) {
+    // Yes. Use that
+    cap = MM_INLINE_SIZE;
+  } else {
+    // No, we need a heap block
+    block = new uint8_t[cap];
+  }
+  // Move data over. Source and target may overlap if both are the inline storage
+  if (MB_size) memmove(block + headLen, MB_buffer + MB_head, MB_size);
+  if (onHeap() && MB_buffer != block) delete[] MB_buffer;
+  MB_buffer = block;
+  MB_capacity = cap;
+  MB_head = headLen;
+}
+
+// reserve: make room for at least newCapacity data bytes. Returns false if that would exceed MM_MAXSIZE.
+bool MessageBuffer::reserve(uint32_t newCapacity) {
+  uint32_t needed = MB_head + newCapacity;
+  // Beyond the limit?
+  if (needed > MM_MAXSIZE) return false;
+  // Do we need more room?
+  if (needed > MB_capacity) {
+    // Yes. Grow at least by half the current capacity to keep reallocations rare
+    uint32_t cap = MB_capacity + (MB_capacity >> 1);
+    if (cap > MM_MAXSIZE) cap = MM_MAXSIZE;
+    reallocate(cap < needed ? needed : cap, MB_head);
+  }
+  return true;
+}
+
+// reserveHead: make room for at least headLen bytes in front of the data.
+// Returns false if that would exceed MM_MAXSIZE.
+bool MessageBuffer::reserveHead(uint16_t headLen) {
+  // Do we need more headroom?
+  if (headLen > MB_head) {
+    // Yes. Beyond the limit?
+    if ((uint32_t)headLen + MB_size > MM_MAXSIZE) return false;
+    // No. Will it fit into the current storage?
+    if (headLen + MB_size <= MB_capacity) {
+      // Yes. Just shift the data up
+      if (MB_size) memmove(MB_buffer + headLen, MB_buffer + MB_head, MB_size);
+      MB_head = headLen;
+    } else {
+      // No. Get new storage, keeping the room for data we had before
+      uint32_t dataRoom = MB_capacity - MB_head;
+      uint32_t cap = headLen + (dataRoom < MB_size ? MB_size : dataRoom);
+      reallocate(cap > MM_MAXSIZE ? MM_MAXSIZE : cap, headLen);
+    }
+  }
+  return true;
+}
+
+// resize: set size, added bytes will be 0x00. The size is clipped to the room left below MM_MAXSIZE.
+void MessageBuffer::resize(uint16_t newSize) {
+  if (newSize > MM_MAXSIZE - MB_head) newSize = MM_MAXSIZE - MB_head;
+  if (newSize > MB_size) {
+    reserve(newSize);
+    memset(data() + MB_size, 0, newSize - MB_size);
+  }
+  MB_size = newSize;
+}
+
+// append: copy len bytes to the end. Nothing is copied if the data would exceed MM_MAXSIZE.
+bool MessageBuffer::append(const uint8_t *src, uint32_t len) {
+  if (len) {
+    // Source may be our own data, that would be invalidated by a reallocation
+    if (MB_buffer && src >= data() && src < data() + MB_size) {
+      uint16_t offset = src - data();
+      if (!reserve(MB_size + len)) return false;
+      src = data() + offset;
+    } else {
+      if (!reserve(MB_size + len)) return false;
+    }
+    memmove(data() + MB_size, src, len);
+    MB_size += len;
+  }
+  return true;
+}
+
+// grow: add len uninitialized bytes to the end, return their address.
+// Returns nullptr if the data would exceed MM_MAXSIZE.
+uint8_t *MessageBuffer::grow(uint32_t len) {
+  if (!reserve(MB_size + len)) return nullptr;
+  uint8_t *cp = data() + MB_size;
+  MB_size += len;
+  return cp;
+}
+
+// shrink_to_fit: release unused heap memory
+void MessageBuffer::shrink_to_fit() {
+  // Only a heap block may be shrunk
+  if (onHeap() && MB_head + MB_size < MB_capacity) {
+    reallocate(MB_head + MB_size, MB_head);
+  }
+}
+
+// ModbusMessageView: view on the data of a ModbusMessage
+ModbusMessageView::ModbusMessageView(const ModbusMessage& m) :
+  MV_data(m.data()),
+  MV_size(m.size()) { }
+
+// Get data[0] (server ID)
+uint8_t ModbusMessageView::getServerID() const {
+  // Only if we have data and it is at least as long to fit serverID and function code, return serverID
+  if (MV_size >= 2) { return MV_data[0]; }
+  // Else return 0 - normally the Broadcast serverID, but we will not support that. Full stop. :-D
+  return 0;
+}
+
+// Get data[1] (function code)
+uint8_t ModbusMessageView::getFunctionCode() const {
+  // Only if we have data and it is at least as long to fit serverID and function code, return FC
+  if (MV_size >= 2) { return MV_data[1]; }
+  // Else return 0 - which is no valid Modbus FC.
+  return 0;
+}
+
+// getError() - returns error code
+Error ModbusMessageView::getError() const {
+  // Do we have data long enough?
+  if (MV_size > 2) {
+    // Yes. Does it indicate an error?
+    if (MV_data[1] & 0x80)
+    {
+      // Yes. Get it.
+      return static_cast<Modbus::Error>(MV_data[2]);
+    }
+  }
+  // Default: everything OK - SUCCESS
+  return SUCCESS;
+}
+
+// get() variants for float and double values
+// values will be read in IEEE754 byte sequence (MSB first)
+uint16_t ModbusMessageView::get(uint16_t index, float& v, int swapRule) const {
+  // First check if we need to determine byte order
+  if (ModbusMessage::determineFloatOrder()) {
+    // If we get here, the floatOrder is known
+    // Will it fit?
+    if (index + sizeof(float) <= MV_size) {
+      // Yes. Get the bytes of v in normalized sequence
+      uint8_t *bytes = (uint8_t *)&v;
+      for (uint8_t i = 0; i < sizeof(float); ++i) {
+        bytes[i] = MV_data[index + ModbusMessage::floatOrder[i]];
+      }
+      HEXDUMP_V("got float", (uint8_t *)&v, sizeof(float));
+      // Do we need to apply a swap rule?
+      if (swapRule & 0x0B) {
+        // Yes, so do it.
+        ModbusMessage::swapFloat(v, swapRule & 0x0B);
+      }
+      HEXDUMP_V("got float swapped", (uint8_t *)&v, sizeof(float));
+      index += sizeof(float);
+    }
+  }
+
+  return index;
+}
+
+uint16_t ModbusMessageView::get(uint16_t index, double& v, int swapRule) const {
+  // First check if we need to determine byte order
+  if (ModbusMessage::determineDoubleOrder()) {
+    // If we get here, the doubleOrder is known
+    // Will it fit?
+    if (index + sizeof(double) <= MV_size) {
+      // Yes. Get the bytes of v in normalized sequence
+      uint8_t *bytes = (uint8_t *)&v;
+      for (uint8_t i = 0; i < sizeof(double); ++i) {
+        bytes[i] = MV_data[index + ModbusMessage::doubleOrder[i]];
+      }
+      HEXDUMP_V("got double", (uint8_t *)&v, sizeof(double));
+      // Do we need to apply a swap rule?
+      if (swapRule & 0x0F) {
+        // Yes, so do it.
+        ModbusMessage::swapDouble(v, swapRule & 0x0F);
+      }
+      HEXDUMP_V("got double swapped", (uint8_t *)&v, sizeof(double));
+      index += sizeof(double);
+    }
+  }
+
+  return index;
+}
+
+// get() - read a byte array of a given size into a vector<uint8_t>. Returns updated index
+uint16_t ModbusMessageView::get(uint16_t index, vector<uint8_t>& v, uint8_t count) const {
+  // Clean target vector
+  v.clear();
+  // Loop until required count is complete or the source is exhausted
+  while (index < MV_size && count--) {
+    v.push_back(MV_data[index++]);
+  }
+  return index;
+}
+
+// getRegisters() - read count consecutive values into an array. Returns updated index
+uint16_t ModbusMessageView::getRegisters(uint16_t index, uint16_t *out, uint16_t count) const {
+  return getBlock(index, (uint8_t *)out, count, sizeof(uint16_t), hostMask(sizeof(uint16_t)), false);
+}
+
+uint16_t ModbusMessageView::getRegisters(uint16_t index, uint32_t *out, uint16_t count, int swapRules) const {
+  // Only SWAP_BYTES and SWAP_REGISTERS apply to 4-byte values
+  return getBlock(index, (uint8_t *)out, count, sizeof(uint32_t), hostMask(sizeof(uint32_t)) ^ (swapRules & 0x03), swapRules & 0x08);
+}
+
+uint16_t ModbusMessageView::getRegisters(uint16_t index, int32_t *out, uint16_t count, int swapRules) const {
+  return getRegisters(index, (uint32_t *)out, count, swapRules);
+}
+
+uint16_t ModbusMessageView::getRegisters(uint16_t index, float *out, uint16_t count, int swapRules) const {
+  // Resolve the byte order once for the whole array
+  int mask = ModbusMessage::floatMask(swapRules);
+  if (mask >= 0) {
+    return getBlock(index, (uint8_t *)out, count, sizeof(float), mask, swapRules & 0x08);
+  }
+  // Exotic float format - go value by value. Will all values fit?
+  if (index + count * sizeof(float) > MV_size) return index;
+  for (uint16_t i = 0; i < count; ++i) {
+    index = get(index, out[i], swapRules);
+  }
+  return index;
+}
+
+uint16_t ModbusMessageView::getRegisters(uint16_t index, double *out, uint16_t count, int swapRules) const {
+  // Resolve the byte order once for the whole array
+  int mask = ModbusMessage::doubleMask(swapRules);
+  if (mask >= 0) {
+    return getBlock(index, (uint8_t *)out, count, sizeof(double), mask, swapRules & 0x08);
+  }
+  // Exotic double format - go value by value. Will all values fit?
+  if (index + count * sizeof(double) > MV_size) return index;
+  for (uint16_t i = 0; i < count; ++i) {
+    index = get(index, out[i], swapRules);
+  }
+  return index;
+}
+
+// getBlock() - copy count values of size bytes to out, re-ordering their bytes. Returns updated index
+uint16_t ModbusMessageView::getBlock(uint16_t index, uint8_t *out, uint16_t count, uint8_t size, uint8_t mask, bool nibbles) const {
+  uint32_t len = count * size;
+  // Will all values fit?
+  if (index + len > MV_size) return index;
+  swapBlock(out, MV_data + index, len, mask, nibbles);
+  return index + len;
+}
 
 // Default Constructor - takes optional size of MM_data to allocate memory
 ModbusMessage::ModbusMessage(uint16_t dataLen) {
   if (dataLen) MM_data.reserve(dataLen);
 }
 
-// Special message Constructor - takes a std::vector<uint8_t>
+// Special message Constructor - takes a std::vector<uint8_t>. If it has more than
+// MM_MAXSIZE bytes, the message will be empty.
 ModbusMessage::ModbusMessage(std::vector<uint8_t> s) :
-MM_data(s) { }
+MM_data(s.data(), s.size()) { }
+
+// Special message Constructor - copies the data of a ModbusMessageView
+ModbusMessage::ModbusMessage(const ModbusMessageView& v) :
+MM_data(v.data(), v.size()) { }
 
 // Destructor
 ModbusMessage::~ModbusMessage() { 
@@ -78,8 +505,8 @@ ModbusMessage::operator bool() {
 }
 
 // Exposed methods of std::vector
-const uint8_t *ModbusMessage::data() { return MM_data.data(); }
-uint16_t       ModbusMessage::size() { return MM_data.size(); }
+const uint8_t *ModbusMessage::data() const { return MM_data.data(); }
+uint16_t       ModbusMessage::size() const { return MM_data.size(); }
 void           ModbusMessage::push_back(const uint8_t& val) { MM_data.push_back(val); }
 void           ModbusMessage::clear() { MM_data.clear(); }
 // provide restricted operator[] interface
@@ -96,45 +523,39 @@ uint16_t ModbusMessage::resize(uint16_t newSize) {
   return MM_data.size(); 
 }
 
+// headroom: make len bytes in front of the data available
+uint8_t *ModbusMessage::headroom(uint8_t len) {
+  if (!MM_data.reserveHead(len)) return nullptr;
+  return MM_data.data() - len;
+}
+
+// tailroom: make len bytes behind the data available
+uint8_t *ModbusMessage::tailroom(uint16_t len) {
+  if (!MM_data.reserve((uint32_t)MM_data.size() + len)) return nullptr;
+  return MM_data.data() + MM_data.size();
+}
+
 // Add append() for two ModbusMessages or a std::vector<uint8_t> to be appended
 void ModbusMessage::append(ModbusMessage& m) { 
-  MM_data.reserve(size() + m.size()); 
-  MM_data.insert(MM_data.end(), m.begin(), m.end()); 
+  MM_data.append(m.data(), m.size());
 }
 
 void ModbusMessage::append(std::vector<uint8_t>& m) { 
-  MM_data.reserve(size() + m.size()); 
-  MM_data.insert(MM_data.end(), m.begin(), m.end()); 
+  MM_data.append(m.data(), m.size());
 }
 
 uint8_t ModbusMessage::getServerID() const {
-  // Only if we have data and it is at least as long to fit serverID and function code, return serverID
-  if (MM_data.size() >= 2) { return MM_data[0]; }
-  // Else return 0 - normally the Broadcast serverID, but we will not support that. Full stop. :-D
-  return 0;
+  return ModbusMessageView(*this).getServerID();
 }
 
 // Get MM_data[0] (server ID) and MM_data[1] (function code)
 uint8_t ModbusMessage::getFunctionCode() const {
-  // Only if we have data and it is at least as long to fit serverID and function code, return FC
-  if (MM_data.size() >= 2) { return MM_data[1]; }
-  // Else return 0 - which is no valid Modbus FC.
-  return 0;
+  return ModbusMessageView(*this).getFunctionCode();
 }
 
 // getError() - returns error code
 Error ModbusMessage::getError() const {
-  // Do we have data long enough?
-  if (MM_data.size() > 2) {
-    // Yes. Does it indicate an error?
-    if (MM_data[1] & 0x80)
-    {
-      // Yes. Get it.
-      return static_cast<Modbus::Error>(MM_data[2]);
-    }
-  }
-  // Default: everything OK - SUCCESS
-  return SUCCESS;
+  return ModbusMessageView(*this).getError();
 }
 
 // Modbus data manipulation
@@ -156,10 +577,8 @@ void    ModbusMessage::setFunctionCode(uint8_t FC) {
 
 // add() variant to copy a buffer into MM_data. Returns updated size
 uint16_t ModbusMessage::add(const uint8_t *arrayOfBytes, uint16_t count) {
-  uint16_t originalSize = MM_data.size();
-  MM_data.resize(originalSize + count);
   // Copy it
-  std::copy(arrayOfBytes, arrayOfBytes + count, MM_data.begin() + originalSize);
+  MM_data.append(arrayOfBytes, count);
   // Return updated size (logical length of message so far)
   return MM_data.size();
 }
@@ -303,9 +722,32 @@ double ModbusMessage::swapDouble(double& f, int swapRule) {
   return interim;
 }
 
+// floatMask(), doubleMask(): combined native byte order and swapRule as a swapBlock() mask.
+// All swapTables permutations are of the form i ^ rule, so if the native order is i ^ n
+// as well, both combine to i ^ (n ^ rule).
+int ModbusMessage::floatMask(int swapRule) {
+  if (!determineFloatOrder()) return -1;
+  uint8_t native = floatOrder[0];
+  for (uint8_t i = 1; i < sizeof(float); ++i) {
+    if (floatOrder[i] != (i ^ native)) return -1;
+  }
+  // Only SWAP_BYTES and SWAP_REGISTERS apply to floats
+  return native ^ (swapRule & 0x03);
+}
+
+int ModbusMessage::doubleMask(int swapRule) {
+  if (!determineDoubleOrder()) return -1;
+  uint8_t native = doubleOrder[0];
+  for (uint8_t i = 1; i < sizeof(double); ++i) {
+    if (doubleOrder[i] != (i ^ native)) return -1;
+  }
+  return native ^ (swapRule & 0x07);
+}
+
 // add() variant for a vector of uint8_t
 uint16_t ModbusMessage::add(vector<uint8_t> v) {
-  return add(v.data(), v.size());
+  MM_data.append(v.data(), v.size());
+  return MM_data.size();
 }
 
 // add() variants for float and double values
@@ -369,66 +811,89 @@ uint16_t ModbusMessage::add(double v, int swapRule) {
 }
 
 // get() variants for float and double values
-// values will be read in IEEE754 byte sequence (MSB first)
 uint16_t ModbusMessage::get(uint16_t index, float& v, int swapRule) const {
-  // First check if we need to determine byte order
-  if (determineFloatOrder()) {
-    // If we get here, the floatOrder is known
-    // Will it fit?
-    if (index <= MM_data.size() - sizeof(float)) {
-      // Yes. Get the bytes of v in normalized sequence
-      uint8_t *bytes = (uint8_t *)&v;
-      for (uint8_t i = 0; i < sizeof(float); ++i) {
-        bytes[i] = MM_data[index + floatOrder[i]];
-      }
-      HEXDUMP_V("got float", (uint8_t *)&v, sizeof(float));
-      // Do we need to apply a swap rule?
-      if (swapRule & 0x0B) {
-        // Yes, so do it.
-        swapFloat(v, swapRule & 0x0B);
-      }
-      HEXDUMP_V("got float swapped", (uint8_t *)&v, sizeof(float));
-      index += sizeof(float);
-    }
-  }
-
-  return index;
+  return ModbusMessageView(*this).get(index, v, swapRule);
 }
 
 uint16_t ModbusMessage::get(uint16_t index, double& v, int swapRule) const {
-  // First check if we need to determine byte order
-  if (determineDoubleOrder()) {
-    // If we get here, the doubleOrder is known
-    // Will it fit?
-    if (index <= MM_data.size() - sizeof(double)) {
-      // Yes. Get the bytes of v in normalized sequence
-      uint8_t *bytes = (uint8_t *)&v;
-      for (uint8_t i = 0; i < sizeof(double); ++i) {
-        bytes[i] = MM_data[index + doubleOrder[i]];
-      }
-      HEXDUMP_V("got double", (uint8_t *)&v, sizeof(double));
-      // Do we need to apply a swap rule?
-      if (swapRule & 0x0F) {
-        // Yes, so do it.
-        swapDouble(v, swapRule & 0x0F);
-      }
-      HEXDUMP_V("got double swapped", (uint8_t *)&v, sizeof(double));
-      index += sizeof(double);
-    }
-  }
-
-  return index;
+  return ModbusMessageView(*this).get(index, v, swapRule);
 }
 
 // get() - read a byte array of a given size into a vector<uint8_t>. Returns updated index
 uint16_t ModbusMessage::get(uint16_t index, vector<uint8_t>& v, uint8_t count) const {
-  // Clean target vector
-  v.clear();
-  // Loop until required count is complete or the source is exhausted
-  while (index < MM_data.size() && count--) {
-    v.push_back(MM_data[index++]);
+  return ModbusMessageView(*this).get(index, v, count);
+}
+
+// addRegisters() - add count values from an array MSB first. Returns updated size
+uint16_t ModbusMessage::addRegisters(const uint16_t *in, uint16_t count) {
+  return addBlock((const uint8_t *)in, count, sizeof(uint16_t), hostMask(sizeof(uint16_t)), false);
+}
+
+uint16_t ModbusMessage::addRegisters(const uint32_t *in, uint16_t count, int swapRules) {
+  // Only SWAP_BYTES and SWAP_REGISTERS apply to 4-byte values
+  return addBlock((const uint8_t *)in, count, sizeof(uint32_t), hostMask(sizeof(uint32_t)) ^ (swapRules & 0x03), swapRules & 0x08);
+}
+
+uint16_t ModbusMessage::addRegisters(const int32_t *in, uint16_t count, int swapRules) {
+  return addRegisters((const uint32_t *)in, count, swapRules);
+}
+
+uint16_t ModbusMessage::addRegisters(const float *in, uint16_t count, int swapRules) {
+  // Resolve the byte order once for the whole array
+  int mask = floatMask(swapRules);
+  if (mask >= 0) {
+    return addBlock((const uint8_t *)in, count, sizeof(float), mask, swapRules & 0x08);
   }
-  return index;
+  // Exotic float format - go value by value
+  MM_data.reserve(MM_data.size() + count * sizeof(float));
+  for (uint16_t i = 0; i < count; ++i) {
+    add(in[i], swapRules);
+  }
+  return MM_data.size();
+}
+
+uint16_t ModbusMessage::addRegisters(const double *in, uint16_t count, int swapRules) {
+  // Resolve the byte order once for the whole array
+  int mask = doubleMask(swapRules);
+  if (mask >= 0) {
+    return addBlock((const uint8_t *)in, count, sizeof(double), mask, swapRules & 0x08);
+  }
+  // Exotic double format - go value by value
+  MM_data.reserve(MM_data.size() + count * sizeof(double));
+  for (uint16_t i = 0; i < count; ++i) {
+    add(in[i], swapRules);
+  }
+  return MM_data.size();
+}
+
+// getRegisters() - read count consecutive values into an array. Returns updated index
+uint16_t ModbusMessage::getRegisters(uint16_t index, uint16_t *out, uint16_t count) const {
+  return ModbusMessageView(*this).getRegisters(index, out, count);
+}
+
+uint16_t ModbusMessage::getRegisters(uint16_t index, uint32_t *out, uint16_t count, int swapRules) const {
+  return ModbusMessageView(*this).getRegisters(index, out, count, swapRules);
+}
+
+uint16_t ModbusMessage::getRegisters(uint16_t index, int32_t *out, uint16_t count, int swapRules) const {
+  return ModbusMessageView(*this).getRegisters(index, out, count, swapRules);
+}
+
+uint16_t ModbusMessage::getRegisters(uint16_t index, float *out, uint16_t count, int swapRules) const {
+  return ModbusMessageView(*this).getRegisters(index, out, count, swapRules);
+}
+
+uint16_t ModbusMessage::getRegisters(uint16_t index, double *out, uint16_t count, int swapRules) const {
+  return ModbusMessageView(*this).getRegisters(index, out, count, swapRules);
+}
+
+// addBlock() - add count values of size bytes, re-ordering their bytes. Returns updated size
+uint16_t ModbusMessage::addBlock(const uint8_t *in, uint16_t count, uint8_t size, uint8_t mask, bool nibbles) {
+  uint32_t len = (uint32_t)count * size;
+  uint8_t *cp = MM_data.grow(len);
+  // Will not fit? Then nothing is added.
+  if (cp) swapBlock(cp, in, len, mask, nibbles);
+  return MM_data.size();
 }
 
 // Data validation methods for the different factory calls
@@ -567,9 +1032,8 @@ Error ModbusMessage::setMessage(uint8_t serverID, uint8_t functionCode) {
   if (returnCode == SUCCESS)
   {
     // Yes, all fine. Create new ModbusMessage
-    MM_data.reserve(2);
-    MM_data.shrink_to_fit();
     MM_data.clear();
+    MM_data.reserve(2);
     add(serverID, functionCode);
   }
   return returnCode;
@@ -583,9 +1047,8 @@ Error ModbusMessage::setMessage(uint8_t serverID, uint8_t functionCode, uint16_t
   if (returnCode == SUCCESS)
   {
     // Yes, all fine. Create new ModbusMessage
-    MM_data.reserve(4);
-    MM_data.shrink_to_fit();
     MM_data.clear();
+    MM_data.reserve(4);
     add(serverID, functionCode, p1);
   }
   return returnCode;
@@ -599,9 +1062,8 @@ Error ModbusMessage::setMessage(uint8_t serverID, uint8_t functionCode, uint16_t
   if (returnCode == SUCCESS)
   {
     // Yes, all fine. Create new ModbusMessage
-    MM_data.reserve(6);
-    MM_data.shrink_to_fit();
     MM_data.clear();
+    MM_data.reserve(6);
     add(serverID, functionCode, p1, p2);
   }
   return returnCode;
@@ -615,9 +1077,8 @@ Error ModbusMessage::setMessage(uint8_t serverID, uint8_t functionCode, uint16_t
   if (returnCode == SUCCESS)
   {
     // Yes, all fine. Create new ModbusMessage
-    MM_data.reserve(8);
-    MM_data.shrink_to_fit();
     MM_data.clear();
+    MM_data.reserve(8);
     add(serverID, functionCode, p1, p2, p3);
   }
   return returnCode;
@@ -631,9 +1092,8 @@ Error ModbusMessage::setMessage(uint8_t serverID, uint8_t functionCode, uint16_t
   if (returnCode == SUCCESS)
   {
     // Yes, all fine. Create new ModbusMessage
-    MM_data.reserve(7 + count * 2);
-    MM_data.shrink_to_fit();
     MM_data.clear();
+    MM_data.reserve(7 + count * 2);
     add(serverID, functionCode, p1, p2);
     add(count);
     for (uint8_t i = 0; i < (count >> 1); ++i) {
@@ -651,9 +1111,8 @@ Error ModbusMessage::setMessage(uint8_t serverID, uint8_t functionCode, uint16_t
   if (returnCode == SUCCESS)
   {
     // Yes, all fine. Create new ModbusMessage
-    MM_data.reserve(7 + count);
-    MM_data.shrink_to_fit();
     MM_data.clear();
+    MM_data.reserve(7 + count);
     add(serverID, functionCode, p1, p2);
     add(count);
     for (uint8_t i = 0; i < count; ++i) {
@@ -671,9 +1130,8 @@ Error ModbusMessage::setMessage(uint8_t serverID, uint8_t functionCode, uint16_t
   if (returnCode == SUCCESS)
   {
     // Yes, all fine. Create new ModbusMessage
-    MM_data.reserve(2 + count);
-    MM_data.shrink_to_fit();
     MM_data.clear();
+    MM_data.reserve(2 + count);
     add(serverID, functionCode);
     for (uint8_t i = 0; i < count; ++i) {
       add(arrayOfBytes[i]);
@@ -685,9 +1143,8 @@ Error ModbusMessage::setMessage(uint8_t serverID, uint8_t functionCode, uint16_t
 // 8. Error response generator
 Error ModbusMessage::setError(uint8_t serverID, uint8_t functionCode, Error errorCode) {
   // No error checking for server ID or function code here, as both may be the cause for the message!? 
-  MM_data.reserve(3);
-  MM_data.shrink_to_fit();
   MM_data.clear();
+  MM_data.reserve(3);
   add(serverID, static_cast<uint8_t>((functionCode | 0x80) & 0xFF), static_cast<uint8_t>(errorCode));
   return SUCCESS;
 }
@@ -14,6 +14,167 @@ using Modbus::FCType;
 using Modbus::FCT;
 using std::vector;
 
+// MM_INLINE_SIZE: number of message bytes held inside the ModbusMessage object itself.
+// With the default of 0 all message data is allocated on the heap. Setting it (f.i. by
+// the build flag -DMM_INLINE_SIZE=264) to at least the maximum Modbus ADU length will
+// let all regular messages live without any heap allocation. Larger messages still will
+// be moved to the heap transparently.
+#ifndef MM_INLINE_SIZE
+#define MM_INLINE_SIZE 0
+#endif
+
+// Largest storage a message may have, headroom included. Anything beyond is refused.
+#define MM_MAXSIZE 0xFFFF
+
+// MessageBuffer: byte storage for ModbusMessage, providing the subset of std::vector<uint8_t>
+// functions ModbusMessage needs. Data is kept inline up to MM_INLINE_SIZE bytes, beyond
+// that a heap block is used. Optionally some headroom is kept in front of the data,
+// so a protocol header (like the Modbus TCP MBAP) can be put there without moving the data.
+class MessageBuffer {
+public:
+  MessageBuffer();
+  MessageBuffer(const uint8_t *data, uint32_t len);
+  MessageBuffer(const MessageBuffer& b);
+  MessageBuffer& operator=(const MessageBuffer& b);
+#ifndef NO_MOVE
+  MessageBuffer(MessageBuffer&& b);
+  MessageBuffer& operator=(MessageBuffer&& b);
+#endif
+  ~MessageBuffer();
+
+  inline uint8_t *data()                           { return MB_buffer + MB_head; }
+  inline const uint8_t *data() const               { return MB_buffer + MB_head; }
+  inline uint16_t size() const                     { return MB_size; }
+  inline uint16_t capacity() const                 { return MB_capacity - MB_head; }
+  inline uint16_t headroom() const                 { return MB_head; }
+  inline bool empty() const                        { return MB_size == 0; }
+  inline uint8_t& operator[](uint16_t index)       { return MB_buffer[MB_head + index]; }
+  inline uint8_t operator[](uint16_t index) const  { return MB_buffer[MB_head + index]; }
+  inline const uint8_t *begin() const              { return data(); }
+  inline const uint8_t *end() const                { return data() + MB_size; }
+  inline void clear()                              { MB_size = 0; }
+  inline bool push_back(uint8_t b) {
+    if (MB_head + MB_size >= MB_capacity && !reserve(MB_size + 1)) return false;
+    MB_buffer[MB_head + MB_size++] = b;
+    return true;
+  }
+
+  // All of the below will refuse to go beyond MM_MAXSIZE and then return false or nullptr
+  bool reserve(uint32_t newCapacity);     // make room for at least newCapacity data bytes
+  bool reserveHead(uint16_t headLen);     // make room for at least headLen bytes in front of the data
+  void resize(uint16_t newSize);          // set size, added bytes will be 0x00. Clipped to the room left.
+  bool append(const uint8_t *data, uint32_t len);  // copy len bytes to the end
+  uint8_t *grow(uint32_t len);            // add len uninitialized bytes to the end, return their address
+  void shrink_to_fit();                   // release unused heap memory
+
+protected:
+  inline bool onHeap() const { return MB_buffer != inlineBuffer(); }
+#if MM_INLINE_SIZE > 0
+  inline uint8_t *inlineBuffer()             { return MB_inline; }
+  inline const uint8_t *inlineBuffer() const { return MB_inline; }
+#else
+  inline uint8_t *inlineBuffer()             { return nullptr; }
+  inline const uint8_t *inlineBuffer() const { return nullptr; }
+#endif
+  // reallocate: move data into storage of (at least) cap bytes with headLen bytes headroom
+  void reallocate(uint32_t cap, uint16_t headLen);
+
+  uint8_t *MB_buffer;                     // Start of storage - inline or heap
+  uint16_t MB_capacity;                   // Number of bytes MB_buffer can hold, including headroom
+  uint16_t MB_head;                       // Number of bytes reserved in front of the data
+  uint16_t MB_size;                       // Number of data bytes used
+#if MM_INLINE_SIZE > 0
+  uint8_t MB_inline[MM_INLINE_SIZE];      // Inline storage
+#endif
+};
+
+class ModbusMessage;
+
+// ModbusMessageView: read-only, non-owning view on message data (pointer plus length).
+// It provides the same data extraction functions as ModbusMessage, but will not copy the data.
+// The view is valid only as long as the data it is pointing to, so do not keep it beyond a call!
+class ModbusMessageView {
+public:
+  // Default empty view
+  ModbusMessageView() : MV_data(nullptr), MV_size(0) {}
+
+  // View on a block of len bytes
+  ModbusMessageView(const uint8_t *data, uint16_t len) : MV_data(data), MV_size(len) {}
+
+  // View on the data of a ModbusMessage
+  explicit ModbusMessageView(const ModbusMessage& m);
+
+  // Exposed methods of std::vector
+  inline const uint8_t *data() const { return MV_data; }
+  inline uint16_t size() const { return MV_size; }
+  inline uint8_t operator[](uint16_t index) const { return MV_data[index]; }
+
+  // provide iterator interface on the data
+  typedef const uint8_t *const_iterator;
+  const_iterator begin() const { return MV_data; }
+  const_iterator end() const   { return MV_data + MV_size; }
+
+  // Modbus data extraction
+  uint8_t getServerID() const;      // returns Server ID or 0 if data is shorter than 2
+  uint8_t getFunctionCode() const;  // returns FC or 0 if data is shorter than 2
+  Error   getError() const;         // getError() - returns error code (data[2], if data[1] > 0x7F, else SUCCESS)
+
+  // get() - read a byte array of a given size into a vector<uint8_t>. Returns updated index
+  uint16_t get(uint16_t index, vector<uint8_t>& v, uint8_t count) const;
+
+  // get() - recursion stopper for template function below
+  inline uint16_t get(uint16_t index) const { return index; }
+
+  // Template function to extend getOne(index, A&) to get(index, A&, B&, C&, ...)
+  template <class T, class... Args>
+  typename std::enable_if<!std::is_pointer<T>::value, uint16_t>::type
+  get(uint16_t index, T& v, Args&... args) const {
+    uint16_t pos = getOne(index, v);
+    return get(pos, args...);
+  }
+
+  // get() variants for float and double values
+  uint16_t get(uint16_t index, float& v, int swapRules = 0) const;
+  uint16_t get(uint16_t index, double& v, int swapRules = 0) const;
+
+  // getRegisters() - read count consecutive values into an array. Returns updated index.
+  // If not all values fit into the data, nothing is read and index is returned unchanged.
+  // 32 bit values will honor SWAP_BYTES, SWAP_REGISTERS and SWAP_NIBBLES, doubles SWAP_WORDS in addition.
+  uint16_t getRegisters(uint16_t index, uint16_t *out, uint16_t count) const;
+  uint16_t getRegisters(uint16_t index, uint32_t *out, uint16_t count, int swapRules = 0) const;
+  uint16_t getRegisters(uint16_t index, int32_t *out, uint16_t count, int swapRules = 0) const;
+  uint16_t getRegisters(uint16_t index, float *out, uint16_t count, int swapRules = 0) const;
+  uint16_t getRegisters(uint16_t index, double *out, uint16_t count, int swapRules = 0) const;
+
+protected:
+  // getBlock() - copy count values of size bytes from index on into out, re-ordering the bytes
+  // of each by mask and optionally swapping nibbles. Returns updated index
+  uint16_t getBlock(uint16_t index, uint8_t *out, uint16_t count, uint8_t size, uint8_t mask, bool nibbles) const;
+
+  // getOne() - read a MSB-first value starting at byte index. Returns updated index
+  template <typename T> uint16_t getOne(uint16_t index, T& retval) const {
+    uint16_t sz = sizeof(retval);    // Size of value to be read
+
+    retval = 0;                      // return value
+
+    // Will it fit?
+    if (index + sz <= MV_size) {
+      // Yes. Copy it MSB first
+      while (sz) {
+        sz--;
+        retval <<= 8;
+        retval |= MV_data[index++];
+      }
+    }
+    return index;
+  }
+
+  const uint8_t *MV_data;        // Start of data viewed
+  uint16_t MV_size;              // Length of data viewed
+
+  friend class ModbusMessage;
+};
+
 class ModbusMessage {
 public:
   // Default empty message Constructor - optionally takes expected size of MM_data
@@ -22,6 +183,9 @@ public:
   // Special message Constructor - takes a std::vector<uint8_t>
   explicit ModbusMessage(std::vector<uint8_t> s);
 
+  // Special message Constructor - copies the data of a ModbusMessageView
+  explicit ModbusMessage(const ModbusMessageView& v);
+
   // Message constructors - internally setMessage() is called
   // WARNING: if parameters are invalid, message will _NOT_ be set up!
   template <typename... Args>
@@ -55,15 +219,23 @@ public:
   operator bool();
   
   // Exposed methods of std::vector
-  const uint8_t   *data();  // address of MM_data
-  uint16_t   size();  // used length in MM_data
+  const uint8_t   *data() const;  // address of MM_data
+  uint16_t   size() const;  // used length in MM_data
   uint8_t    operator[](uint16_t index) const; // provide restricted operator[] interface
   void push_back(const uint8_t& val); // add a byte at the end of MM_data
   void clear();             // delete message contents
   uint16_t resize(uint16_t newSize);  // resize MM_data
 
+  // Room around the data to write protocol framing in place - f.i. the TCP header or the RTU CRC.
+  // Both return the address of the room; the frame to send then is (address, size() + len).
+  // Both return nullptr if the message would grow beyond MM_MAXSIZE bytes.
+  // headroom: make len bytes in front of the data available
+  uint8_t *headroom(uint8_t len);
+  // tailroom: make len bytes behind the data available, without adding them to the message
+  uint8_t *tailroom(uint16_t len);
+
   // provide iterator interface on MM_data
-  typedef std::vector<uint8_t>::const_iterator const_iterator;
+  typedef const uint8_t *const_iterator;
   const_iterator begin() const { return MM_data.begin(); }
   const_iterator end() const   { return MM_data.end(); }
 
@@ -114,8 +286,7 @@ inline uint16_t get(uint16_t index) const { return index; }
 template <class T, class... Args>
 typename std::enable_if<!std::is_pointer<T>::value, uint16_t>::type
 get(uint16_t index, T& v, Args&... args) const {
-  uint16_t pos = getOne(index, v);
-  return get(pos, args...);
+  return ModbusMessageView(MM_data.data(), MM_data.size()).get(index, v, args...);
 }
 
 // add() variant for vectors of uint8_t
@@ -129,6 +300,21 @@ uint16_t add(double v, int swapRules = 0);
 uint16_t get(uint16_t index, float& v, int swapRules = 0) const;
 uint16_t get(uint16_t index, double& v, int swapRules = 0) const;
 
+// addRegisters() - add count values from an array MSB first. Returns updated size
+// 32 bit values will honor SWAP_BYTES, SWAP_REGISTERS and SWAP_NIBBLES, doubles SWAP_WORDS in addition.
+uint16_t addRegisters(const uint16_t *in, uint16_t count);
+uint16_t addRegisters(const uint32_t *in, uint16_t count, int swapRules = 0);
+uint16_t addRegisters(const int32_t *in, uint16_t count, int swapRules = 0);
+uint16_t addRegisters(const float *in, uint16_t count, int swapRules = 0);
+uint16_t addRegisters(const double *in, uint16_t count, int swapRules = 0);
+
+// getRegisters() - read count consecutive values into an array. Returns updated index
+uint16_t getRegisters(uint16_t index, uint16_t *out, uint16_t count) const;
+uint16_t getRegisters(uint16_t index, uint32_t *out, uint16_t count, int swapRules = 0) const;
+uint16_t getRegisters(uint16_t index, int32_t *out, uint16_t count, int swapRules = 0) const;
+uint16_t getRegisters(uint16_t index, float *out, uint16_t count, int swapRules = 0) const;
+uint16_t getRegisters(uint16_t index, double *out, uint16_t count, int swapRules = 0) const;
+
   // Message generation methods
   // 1. no additional parameter (FCs 0x07, 0x0b, 0x0c, 0x11)
   Error setMessage(uint8_t serverID, uint8_t functionCode);
@@ -183,7 +369,11 @@ protected:
   // Error output in case a message constructor will fail
   static void printError(const char *file, int lineNo, Error e, uint8_t serverID, uint8_t functionCode);
 
-  std::vector<uint8_t> MM_data;  // Message data buffer
+  // addBlock() - add count values of size bytes from in, re-ordering the bytes of each
+  // by mask and optionally swapping nibbles. Returns updated size
+  uint16_t addBlock(const uint8_t *in, uint16_t count, uint8_t size, uint8_t mask, bool nibbles);
+
+  MessageBuffer MM_data;         // Message data buffer
 
   static uint8_t floatOrder[sizeof(float)]; // order of bytes in a float variable
   static uint8_t doubleOrder[sizeof(double)]; // order of bytes in a double variable
@@ -194,23 +384,17 @@ protected:
   static float swapFloat(float& f, int swapRule);
   static double swapDouble(double& f, int swapRule);
 
+  // floatMask(), doubleMask(): combined native byte order and swapRule as a swapBlock() mask.
+  // Return -1 if the native byte order can not be expressed that way
+  static int floatMask(int swapRule);
+  static int doubleMask(int swapRule);
+
   // getOne() - read a MSB-first value starting at byte index. Returns updated index
   template <typename T> uint16_t getOne(uint16_t index, T& retval) const {
-    uint16_t sz = sizeof(retval);    // Size of value to be read
-
-    retval = 0;                      // return value
-
-    // Will it fit?
-    if (index <= MM_data.size() - sz) {
-      // Yes. Copy it MSB first
-      while (sz) {
-        sz--;
-        retval <<= 8;
-        retval |= MM_data[index++];
-      }
-    }
-    return index;
+    return ModbusMessageView(MM_data.data(), MM_data.size()).getOne(index, retval);
   }
+
+  friend class ModbusMessageView;
 };
 
 #endif
@@ -0,0 +1,116 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _MODBUS_REQUEST_H
+#define _MODBUS_REQUEST_H
+#include "ModbusMessage.h"
+
+// FixedRequest: a complete Modbus request PDU (server ID, function code and parameters)
+// in a fixed size byte array. It is built by makeRequest<FC>() below without any heap
+// use or runtime function code lookup. If the parameters were invalid, size() is 0 and
+// getError() tells why.
+template <uint8_t LEN>
+struct FixedRequest {
+  uint8_t bytes[LEN];
+  uint8_t len;
+  Error err;
+
+  constexpr uint8_t size() const { return len; }
+  constexpr Error getError() const { return err; }
+  constexpr bool isValid() const { return err == Modbus::SUCCESS; }
+  const uint8_t *data() const { return bytes; }
+  const uint8_t *begin() const { return bytes; }
+  const uint8_t *end() const { return bytes + len; }
+
+  // view: a ModbusMessageView on the bytes, to be used where a message is needed
+  ModbusMessageView view() const { return ModbusMessageView(bytes, len); }
+};
+
+namespace ModbusRequestDetail {
+
+// layout: compile time copy of the FCT table entries with a fixed request length.
+// FCs with variable or user defined layouts are mapped to FCILLEGAL here.
+constexpr FCType layout(uint8_t fc) {
+  return (fc >= 0x01 && fc <= 0x06) ? Modbus::FC01_TYPE
+       : (fc == 0x07 || fc == 0x0B || fc == 0x0C || fc == 0x11) ? Modbus::FC07_TYPE
+       : (fc == 0x16) ? Modbus::FC16_TYPE
+       : (fc == 0x18) ? Modbus::FC18_TYPE
+       : Modbus::FCILLEGAL;
+}
+
+// checkServer: same rules as ModbusMessage::checkServerFC()
+constexpr Error checkServer(uint8_t serverID) {
+  return (serverID == 0 || serverID > 247) ? Modbus::INVALID_SERVER : Modbus::SUCCESS;
+}
+
+// checkFC01: same limits as ModbusMessage::checkData() for two uint16_t parameters
+constexpr Error checkFC01(uint8_t serverID, uint8_t fc, uint16_t p2) {
+  return checkServer(serverID) != Modbus::SUCCESS ? checkServer(serverID)
+       : ((fc == 0x01 || fc == 0x02) && (p2 == 0 || p2 > 0x7d0)) ? Modbus::PARAMETER_LIMIT_ERROR
+       : ((fc == 0x03 || fc == 0x04) && (p2 == 0 || p2 > 0x7d)) ? Modbus::PARAMETER_LIMIT_ERROR
+       : (fc == 0x05 && p2 != 0 && p2 != 0xff00) ? Modbus::PARAMETER_LIMIT_ERROR
+       : Modbus::SUCCESS;
+}
+
+// invalid: deliberately not constexpr. A request with bad constant parameters that is
+// evaluated at compile time will end up here and break the build.
+template <uint8_t LEN>
+inline FixedRequest<LEN> invalid(Error e) {
+  return FixedRequest<LEN>{ {0}, 0, e };
+}
+
+constexpr uint8_t hi(uint16_t v) { return uint8_t(v >> 8); }
+constexpr uint8_t lo(uint16_t v) { return uint8_t(v & 0xFF); }
+
+} // namespace ModbusRequestDetail
+
+// makeRequest<FC>: build a request for a fixed layout function code.
+// The function code layout is checked at compile time. The parameter limits are checked
+// at compile time as well, if the result is used in a constant expression, like
+//   constexpr auto req = makeRequest<READ_HOLD_REGISTER>(1, 100, 10);
+// Otherwise an invalid request is returned with size() 0 and the error code set.
+// FCs 0x0F and 0x10 have variable lengths and need a ModbusMessage.
+
+// 1. no additional parameter (FCs 0x07, 0x0b, 0x0c, 0x11)
+template <uint8_t FC>
+constexpr FixedRequest<2> makeRequest(uint8_t serverID) {
+  static_assert(ModbusRequestDetail::layout(FC) == Modbus::FC07_TYPE, "makeRequest: FC does not take zero parameters");
+  return ModbusRequestDetail::checkServer(serverID) != Modbus::SUCCESS
+    ? ModbusRequestDetail::invalid<2>(ModbusRequestDetail::checkServer(serverID))
+    : FixedRequest<2>{ { serverID, FC }, 2, Modbus::SUCCESS };
+}
+
+// 2. one uint16_t parameter (FC 0x18)
+template <uint8_t FC>
+constexpr FixedRequest<4> makeRequest(uint8_t serverID, uint16_t p1) {
+  static_assert(ModbusRequestDetail::layout(FC) == Modbus::FC18_TYPE, "makeRequest: FC does not take one parameter");
+  return ModbusRequestDetail::checkServer(serverID) != Modbus::SUCCESS
+    ? ModbusRequestDetail::invalid<4>(ModbusRequestDetail::checkServer(serverID))
+    : FixedRequest<4>{ { serverID, FC, ModbusRequestDetail::hi(p1), ModbusRequestDetail::lo(p1) }, 4, Modbus::SUCCESS };
+}
+
+// 3. two uint16_t parameters (FC 0x01, 0x02, 0x03, 0x04, 0x05, 0x06)
+template <uint8_t FC>
+constexpr FixedRequest<6> makeRequest(uint8_t serverID, uint16_t p1, uint16_t p2) {
+  static_assert(ModbusRequestDetail::layout(FC) == Modbus::FC01_TYPE, "makeRequest: FC does not take two parameters");
+  return ModbusRequestDetail::checkFC01(serverID, FC, p2) != Modbus::SUCCESS
+    ? ModbusRequestDetail::invalid<6>(ModbusRequestDetail::checkFC01(serverID, FC, p2))
+    : FixedRequest<6>{ { serverID, FC,
+        ModbusRequestDetail::hi(p1), ModbusRequestDetail::lo(p1),
+        ModbusRequestDetail::hi(p2), ModbusRequestDetail::lo(p2) }, 6, Modbus::SUCCESS };
+}
+
+// 4. three uint16_t parameters (FC 0x16)
+template <uint8_t FC>
+constexpr FixedRequest<8> makeRequest(uint8_t serverID, uint16_t p1, uint16_t p2, uint16_t p3) {
+  static_assert(ModbusRequestDetail::layout(FC) == Modbus::FC16_TYPE, "makeRequest: FC does not take three parameters");
+  return ModbusRequestDetail::checkServer(serverID) != Modbus::SUCCESS
+    ? ModbusRequestDetail::invalid<8>(ModbusRequestDetail::checkServer(serverID))
+    : FixedRequest<8>{ { serverID, FC,
+        ModbusRequestDetail::hi(p1), ModbusRequestDetail::lo(p1),
+        ModbusRequestDetail::hi(p2), ModbusRequestDetail::lo(p2),
+        ModbusRequestDetail::hi(p3), ModbusRequestDetail::lo(p3) }, 8, Modbus::SUCCESS };
+}
+
+#endif
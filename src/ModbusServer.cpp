@@ -2,8 +2,10 @@
 // eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
 //               MIT license - see license.md for details
 // =================================================================================================
-#include <Arduino.h>
 #include "ModbusServer.h"
+#if !IS_LINUX
+#include <Arduino.h>
+#endif
 
 #undef LOCAL_LOG_LEVEL
 // #define LOCAL_LOG_LEVEL LOG_LEVEL_VERBOSE
@@ -12,12 +14,52 @@
 // registerWorker: register a worker function for a certain serverID/FC combination
 // If there is one already, it will be overwritten!
 void ModbusServer::registerWorker(uint8_t serverID, uint8_t functionCode, MBSworker worker) {
-  workerMap[serverID][functionCode] = worker;
+  WorkerEntry& entry = workerMap[serverID][functionCode];
+  entry.worker = worker;
+  entry.viewWorker = nullptr;
   LOG_D("Registered worker for %02X/%02X\n", serverID, functionCode);
 }
 
+// registerWorker: same for a worker taking a view on the request
+void ModbusServer::registerWorker(uint8_t serverID, uint8_t functionCode, MBSviewWorker worker) {
+  WorkerEntry& entry = workerMap[serverID][functionCode];
+  entry.worker = nullptr;
+  entry.viewWorker = worker;
+  LOG_D("Registered view worker for %02X/%02X\n", serverID, functionCode);
+}
+
 // getWorker: if a worker function is registered, return its address, nullptr otherwise
 MBSworker ModbusServer::getWorker(uint8_t serverID, uint8_t functionCode) {
+  WorkerEntry *entry = findWorker(serverID, functionCode);
+  // Did we find one?
+  if (entry) {
+    // Yes. Is it a regular worker?
+    if (entry->worker) return entry->worker;
+    // No, a view worker. Wrap it to take a ModbusMessage
+    MBSviewWorker viewWorker = entry->viewWorker;
+    return [viewWorker](ModbusMessage msg) { return viewWorker(ModbusMessageView(msg)); };
+  }
+  return nullptr;
+}
+
+// callWorker: call the worker registered for the request. Returns false if there is none
+bool ModbusServer::callWorker(ModbusMessageView request, ModbusMessage& response) {
+  WorkerEntry *entry = findWorker(request.getServerID(), request.getFunctionCode());
+  // Did we find one?
+  if (entry) {
+    // Yes. A view worker can take the request as is, a regular one needs a copy
+    if (entry->viewWorker) {
+      response = entry->viewWorker(request);
+    } else {
+      response = entry->worker(ModbusMessage(request));
+    }
+    return true;
+  }
+  return false;
+}
+
+// findWorker: look up the worker entry for a serverID/FC combination, nullptr if there is none
+ModbusServer::WorkerEntry *ModbusServer::findWorker(uint8_t serverID, uint8_t functionCode) {
   bool serverFound = false;
   LOG_D("Need worker for %02X-%02X : ", serverID, functionCode);
   // Search the FC map associated with the serverID
@@ -53,7 +95,7 @@ MBSworker ModbusServer::getWorker(uint8_t serverID, uint8_t functionCode) {
     if (functionCodeFound) {
       // Yes. Return the function pointer for it.
       LOGRAW_D("Worker found for %02X/%02X\n", serverID, functionCode);
-      return fcmap->second;
+      return &(fcmap->second);
     }
   }
   // No matching function pointer found
@@ -89,7 +131,7 @@ bool ModbusServer::unregisterWorker(uint8_t serverID, uint8_t functionCode) {
 //              including ANY_FUNCTION_CODE :D
 bool ModbusServer::isServerFor(uint8_t serverID, uint8_t functionCode) {
   // Check if there is a non-nullptr function for the given combination
-  if (getWorker(serverID, functionCode)) {
+  if (findWorker(serverID, functionCode)) {
     return true;
   }
   return false;
@@ -139,13 +181,11 @@ ModbusMessage ModbusServer::localRequest(ModbusMessage msg) {
   LOG_D("Local request for %02X/%02X\n", serverID, functionCode);
   HEXDUMP_V("Request", msg.data(), msg.size());
   messageCount++;
-  // Try to get a worker for the request
-  MBSworker worker = getWorker(serverID, functionCode);
+  // Try to get a worker for the request and call it
+  LOG_D("Call worker\n");
   // Did we get one?
-  if (worker != nullptr) {
-    // Yes. call it and return the response
-    LOG_D("Call worker\n");
-    m = worker(msg);
+  if (callWorker(ModbusMessageView(msg), m)) {
+    // Yes. return the response
     LOG_D("Worker responded\n");
     HEXDUMP_V("Worker response", m.data(), m.size());
     // Process Response. Is it one of the predefined types?
@@ -29,11 +29,16 @@ const ModbusMessage ECHO_RESPONSE(std::vector<uint8_t>{0xFF, 0xF1});
 // MBSworker: function signature for worker functions to handle single serverID/functionCode combinations
 using MBSworker = std::function<ModbusMessage(ModbusMessage msg)>;
 
+// MBSviewWorker: worker function variant getting a read-only view on the request instead of a copy.
+// The view is valid only until the worker returns!
+using MBSviewWorker = std::function<ModbusMessage(ModbusMessageView msg)>;
+
 class ModbusServer {
 public:
   // registerWorker: register a worker function for a certain serverID/FC combination
   // If there is one already, it will be overwritten!
   void registerWorker(uint8_t serverID, uint8_t functionCode, MBSworker worker);
+  void registerWorker(uint8_t serverID, uint8_t functionCode, MBSviewWorker worker);
   
   // getWorker: if a worker function is registered, return its address, nullptr otherwise
   MBSworker getWorker(uint8_t serverID, uint8_t functionCode);
@@ -74,7 +79,19 @@ protected:
   ModbusServer(ModbusServer& other) = delete;
   ModbusServer& operator=(ModbusServer& other) = delete;
 
-  std::map<uint8_t, std::map<uint8_t, MBSworker>> workerMap;      // map on serverID->functionCode->worker function
+  // WorkerEntry: registered worker function - only one of both is set
+  struct WorkerEntry {
+    MBSworker worker;              // worker taking a copy of the request
+    MBSviewWorker viewWorker;      // worker taking a view on the request
+  };
+
+  // findWorker: look up the worker entry for a serverID/FC combination, nullptr if there is none
+  WorkerEntry *findWorker(uint8_t serverID, uint8_t functionCode);
+
+  // callWorker: call the worker registered for the request. Returns false if there is none
+  bool callWorker(ModbusMessageView request, ModbusMessage& response);
+
+  std::map<uint8_t, std::map<uint8_t, WorkerEntry>> workerMap;    // map on serverID->functionCode->worker function
   uint32_t messageCount;         // Number of Requests processed
   uint32_t errorCount;           // Number of errors responded
   #if USE_MUTEX
@@ -4,7 +4,7 @@
 // =================================================================================================
 #include "ModbusServerRTU.h"
 
-#if HAS_FREERTOS || HAS_RP2040_FREERTOS
+#if HAS_FREERTOS || HAS_RP2040_FREERTOS || IS_LINUX
 
 #undef LOG_LEVEL_LOCAL
 #include "Logging.h"
@@ -15,7 +15,7 @@ uint8_t ModbusServerRTU::instanceCounter = 0;
 // Constructor with RTS pin GPIO (or -1)
 ModbusServerRTU::ModbusServerRTU(uint32_t timeout, int rtsPin) :
   ModbusServer(),
-  serverTask(nullptr),
+  serverTask(0),
   serverTimeout(timeout),
   MSRserial(nullptr),
   MSRinterval(2000),     // will be calculated in begin()!
@@ -24,9 +24,21 @@ ModbusServerRTU::ModbusServerRTU(uint32_t timeout, int rtsPin) :
   MSRuseASCII(false),
   MSRskipLeadingZeroByte(false),
   listener(nullptr),
-  sniffer(nullptr) {
+  sniffer(nullptr)
+#if HAS_FREERTOS
+  , MSRhwSerial(nullptr)
+#endif
+  {
   // Count instances one up
   instanceCounter++;
+#if IS_LINUX && !IS_RASPBERRY
+  // No GPIOs here - use a RTScallback on the serial device instead
+  if (MSRrtsPin >= 0) {
+    LOG_W("RTS pin %d not supported, use a RTS callback.\n", MSRrtsPin);
+    MSRrtsPin = -1;
+  }
+  MRTSrts = RTUutils::RTSauto;
+#else
   // If we have a GPIO RE/DE pin, configure it.
   if (MSRrtsPin >= 0) {
     pinMode(MSRrtsPin, OUTPUT);
@@ -37,12 +49,13 @@ ModbusServerRTU::ModbusServerRTU(uint32_t timeout, int rtsPin) :
   } else {
     MRTSrts = RTUutils::RTSauto;
   }
+#endif
 }
 
 // Constructor with RTS callback
 ModbusServerRTU::ModbusServerRTU(uint32_t timeout, RTScallback rts) :
   ModbusServer(),
-  serverTask(nullptr),
+  serverTask(0),
   serverTimeout(timeout),
   MSRserial(nullptr),
   MSRinterval(2000),     // will be calculated in begin()!
@@ -51,7 +64,11 @@ ModbusServerRTU::ModbusServerRTU(uint32_t timeout, RTScallback rts) :
   MSRuseASCII(false),
   MSRskipLeadingZeroByte(false),
   listener(nullptr),
-  sniffer(nullptr) {
+  sniffer(nullptr)
+#if HAS_FREERTOS
+  , MSRhwSerial(nullptr)
+#endif
+  {
   // Count instances one up
   instanceCounter++;
   // Configure RTS callback
@@ -59,8 +76,9 @@ ModbusServerRTU::ModbusServerRTU(uint32_t timeout, RTScallback rts) :
   MRTSrts(LOW);
 }
 
-// Destructor
+// Destructor: stop the server task, it would be using a dead object otherwise
 ModbusServerRTU::~ModbusServerRTU() {
+  end();
 }
 
 // start: create task with RTU server - general version
@@ -76,6 +94,14 @@ void ModbusServerRTU::begin(HardwareSerial& serial, int coreID, uint32_t userInt
   uint32_t baudRate = serial.baudRate();
   serial.setRxFIFOFull(1);
   doBegin(baudRate, coreID, userInterval);
+#if HAS_FREERTOS
+  // Wake up the server task as soon as data arrives
+  MSRhwSerial = &serial;
+  serial.onReceive([this]() {
+    TaskHandle_t t = serverTask;
+    if (t) xTaskNotifyGive(t);
+  });
+#endif
 }
 #endif
 
@@ -91,15 +117,25 @@ void ModbusServerRTU::doBegin(uint32_t baudRate, int coreID, uint32_t userInterv
     MSRinterval = userInterval;
   }
 
+#if IS_LINUX
+  // Start thread to handle the client
+  int rc = pthread_create(&serverTask, NULL, &pServe, this);
+  if (rc) {
+    LOG_E("Error creating RTU server thread: %d\n", rc);
+    serverTask = 0;
+    return;
+  }
+#else
   // Create unique task name
   char taskName[18];
   snprintf(taskName, 18, "MBsrv%02XRTU", instanceCounter);
 
   // Start task to handle the client
+#endif
 #if HAS_FREERTOS
   xTaskCreatePinnedToCore((TaskFunction_t)&serve, taskName, SERVER_TASK_STACK,
                           this, 8, &serverTask, coreID >= 0 ? coreID : tskNO_AFFINITY);
-#else
+#elif HAS_RP2040_FREERTOS
   xTaskCreate((TaskFunction_t)&serve, taskName, SERVER_TASK_STACK, this, 8,
               &serverTask);
   EMODBUS_SET_TASK_AFFINITY(serverTask, coreID);
@@ -110,13 +146,37 @@ void ModbusServerRTU::doBegin(uint32_t baudRate, int coreID, uint32_t userInterv
 
 // end: kill server task
 void ModbusServerRTU::end() {
-  if (serverTask != nullptr) {
-    vTaskDelete(serverTask);
-    LOG_D("Server task %d stopped.\n", (uint32_t)serverTask);
-    serverTask = nullptr;
+#if HAS_FREERTOS
+  // Remove the receive callback
+  if (MSRhwSerial) {
+    MSRhwSerial->onReceive(nullptr);
+    MSRhwSerial = nullptr;
+  }
+#endif
+  if (serverTask) {
+#if IS_LINUX
+    pthread_cancel(serverTask);
+    pthread_join(serverTask, NULL);
+    LOG_D("Server thread stopped.\n");
+    serverTask = 0;
+#else
+    // Clear the handle first, a receive callback must not notify a deleted task
+    TaskHandle_t t = serverTask;
+    serverTask = 0;
+    vTaskDelete(t);
+    LOG_D("Server task %d stopped.\n", (uint32_t)t);
+#endif
   }
 }
 
+#if IS_LINUX
+// pServe: thread entry for serve()
+void *ModbusServerRTU::pServe(void *p) {
+  serve(static_cast<ModbusServerRTU *>(p));
+  return nullptr;
+}
+#endif
+
 // Toggle protocol to ModbusASCII
 void ModbusServerRTU::useModbusASCII(unsigned long timeout) {
   MSRuseASCII = true;
@@ -165,9 +225,9 @@ void ModbusServerRTU::registerSniffer(MSRlistener worker) {
 
 // serve: loop until killed and receive messages from the RTU interface
 void ModbusServerRTU::serve(ModbusServerRTU *myServer) {
-  ModbusMessage request;                // received request message
+  ModbusMessage request(256);           // received request message, re-used for all requests
   ModbusMessage m;                      // Application's response data
-  ModbusMessage response;               // Response proper to be sent
+  ModbusMessage response(256);          // Response proper to be sent
 
   // init microseconds timer
   myServer->MSRlastMicros = micros();
@@ -179,9 +239,10 @@ void ModbusServerRTU::serve(ModbusServerRTU *myServer) {
     m.clear();
 
     // Wait for and read an request
-    request = RTUutils::receive(
+    RTUutils::receive(
       'S',
       *(myServer->MSRserial), 
+      request,
       myServer->serverTimeout, 
       myServer->MSRlastMicros, 
       myServer->MSRinterval, 
@@ -210,18 +271,14 @@ void ModbusServerRTU::serve(ModbusServerRTU *myServer) {
         // else we simply ignore it
       } else {
         // No Broadcast. 
-        // Do we have a callback function registered for it?
-        MBSworker callBack = myServer->getWorker(request[0], request[1]);
-        if (callBack) {
-          LOG_D("Callback found.\n");
+        // Do we have a callback function registered for it? Call it to get the user's response
+        if (myServer->callWorker(ModbusMessageView(request), m)) {
+          LOG_D("Callback called.\n");
           // Yes, we do. Count the message
           {
             LOCK_GUARD(cntLock, myServer->m);
             myServer->messageCount++;
           }
-          // Get the user's response
-          LOG_D("Callback called.\n");
-          m = callBack(request);
           HEXDUMP_V("Callback response", m.data(), m.size());
 
           // Process Response. Is it one of the predefined types?
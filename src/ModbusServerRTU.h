@@ -7,9 +7,11 @@
 
 #include "options.h"
 
-#if HAS_FREERTOS || HAS_RP2040_FREERTOS
+#if HAS_FREERTOS || HAS_RP2040_FREERTOS || IS_LINUX
 
+#if !IS_LINUX
 #include <Arduino.h>
+#endif
 #include "Stream.h"
 #include "ModbusServer.h"
 #include "RTUutils.h"
@@ -24,6 +26,8 @@ extern "C" {
 #include <FreeRTOS.h>
 #include <task.h>
 }
+#elif IS_LINUX
+#include <pthread.h>
 #endif 
 // Specal function signature for broadcast or sniffer listeners
 using MSRlistener = std::function<void(ModbusMessage msg)>;
@@ -41,6 +45,9 @@ public:
   void begin(Stream& serial, uint32_t baudRate, int coreID = -1, uint32_t userInterval = 0);
 
   #if defined(ESP32) || defined(ESP8266)   // Special variant for HardwareSerial
+  // ATTENTION: on FreeRTOS, this takes over the serial's onReceive() callback to wake up the
+  // server task, replacing one the application may have set. end() removes it again.
+  // The serial is set to setRxFIFOFull(1) as well.
   void begin(HardwareSerial& serial, int coreID = -1, uint32_t userInterval = 0);
   #endif
   
@@ -77,7 +84,11 @@ protected:
   void doBegin(uint32_t baudRate, int coreID, uint32_t userInterval);
 
   static uint8_t instanceCounter;        // Number of RTU servers created (for task names)
+#if IS_LINUX
+  pthread_t serverTask;                  // thread of the started server
+#else
   TaskHandle_t serverTask;               // task of the started server
+#endif
   uint32_t serverTimeout;                // given timeout for receive. Does not really
                                          // matter for a server, but is needed in 
                                          // RTUutils. After timeout without any message
@@ -92,9 +103,15 @@ protected:
   bool MSRskipLeadingZeroByte;           // true=first byte ignored if 0x00, false=all bytes accepted
   MSRlistener listener;                  // Broadcast listener 
   MSRlistener sniffer;                   // Sniffer listener 
+#if HAS_FREERTOS
+  HardwareSerial *MSRhwSerial;           // HardwareSerial notifying the server task of received data, if any
+#endif
 
   // serve: loop function for server task
   static void serve(ModbusServerRTU *myself);
+#if IS_LINUX
+  static void *pServe(void *p);
+#endif
 };
 
 #endif  // HAS_FREERTOS
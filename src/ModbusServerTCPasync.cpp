@@ -84,14 +84,11 @@ void ModbusServerTCPasync::mb_client::onData(uint8_t* data, size_t len) {
     }
 
     // 4. request complete, process
-    ModbusMessage request(messageLength - 6);  // create request without MBAP, with server ID
-    request.add(message->data() + 6, message->size() - 6);
+    ModbusMessageView request(message->data() + 6, message->size() - 6);  // request without MBAP, with server ID
     ModbusMessage userData;
     if (server->isServerFor(request.getServerID())) {
-      MBSworker callback = server->getWorker(request.getServerID(), request.getFunctionCode());
-      if (callback) {
+      if (server->callWorker(request, userData)) {
         // request is well formed and is being served by user API
-        userData = callback(request);
         // Process Response
         // One of the predefined types?
         if (userData[0] == 0xFF && (userData[1] == 0xF0 || userData[1] == 0xF1)) {
@@ -102,7 +99,7 @@ void ModbusServerTCPasync::mb_client::onData(uint8_t* data, size_t len) {
             LOG_D("NIL response\n");
             break;
           case 0xF1: // ECHO
-            userData = request;
+            userData = ModbusMessage(request);
             if (request.getFunctionCode() == WRITE_MULT_REGISTERS ||
                 request.getFunctionCode() == WRITE_MULT_COILS) {
               userData.resize(6);
@@ -272,20 +272,18 @@ void ModbusServerTCP<ST, CT>::worker(ClientData *myData) {
           LOCK_GUARD(cntLock, myParent->m);
           myParent->messageCount++;
         }
-        // Extract request data
-        ModbusMessage request;
-        request.add(m.data() + 6, m.size() - 6);
+        // Look at the request data behind the TCP header
+        ModbusMessageView request(m.data() + 6, m.size() - 6);
 
         // Protocol ID shall be 0x0000 - is it?
         if (m[2] == 0 && m[3] == 0) {
           // ServerID shall be at [6], FC at [7]. Check both
           if (myParent->isServerFor(request.getServerID())) {
             // Server is correct - in principle. Do we serve the FC?
-            MBSworker callBack = myParent->getWorker(request.getServerID(), request.getFunctionCode());
-            if (callBack) {
+            // If so, invoke the worker method to get a response
+            ModbusMessage data;
+            if (myParent->callWorker(request, data)) {
               // Yes, we do.
-              // Invoke the worker method to get a response
-              ModbusMessage data = callBack(request);
               // Process Response
               // One of the predefined types?
               if (data[0] == 0xFF && (data[1] == 0xF0 || data[1] == 0xF1)) {
@@ -296,7 +294,7 @@ void ModbusServerTCP<ST, CT>::worker(ClientData *myData) {
                   LOG_D("NIL response\n");
                   break;
                 case 0xF1: // ECHO
-                  response = request;
+                  response = ModbusMessage(request);
                   if (request.getFunctionCode() == WRITE_MULT_REGISTERS ||
                       request.getFunctionCode() == WRITE_MULT_COILS) {
                     response.resize(6);
@@ -328,13 +326,13 @@ void ModbusServerTCP<ST, CT>::worker(ClientData *myData) {
       // Do we have a response to send?
       if (response.size() >= 3) {
         // Yes. Do it now.
-        // Cut off length and request data, then update TCP header
-        m.resize(4);
-        m.add(static_cast<uint16_t>(response.size()));
-        // Append response
-        m.append(response);
-        myClient.write(m.data(), m.size());
-        HEXDUMP_V("Response", m.data(), m.size());
+        // Put the TCP header in front of the response: transaction and protocol IDs from the request, new length
+        uint8_t *packet = response.headroom(6);
+        memcpy(packet, m.data(), 4);
+        packet[4] = (response.size() >> 8) & 0xFF;
+        packet[5] = response.size() & 0xFF;
+        myClient.write(packet, response.size() + 6);
+        HEXDUMP_V("Response", packet, response.size() + 6);
         // count error responses
         if (response.getError() != SUCCESS) {
           LOCK_GUARD(cntLock, myParent->m);
@@ -26,7 +26,10 @@ public:
   static uint16_t calcCRC(const uint8_t *data, uint16_t len);
 
 // calcCRC: calculate the CRC16 value for a given block of data
-  static uint16_t calcCRC(ModbusMessage msg);
+  static uint16_t calcCRC(const ModbusMessage& msg);
+
+// updateCRC: continue a CRC16 calculation (start value 0xFFFF) with another block of data
+  static uint16_t updateCRC(uint16_t crc, const uint8_t *data, uint16_t len);
 
 // validCRC #1: check the CRC in a block of data for validity
   static bool validCRC(const uint8_t *data, uint16_t len);
@@ -35,10 +38,10 @@ public:
   static bool validCRC(const uint8_t *data, uint16_t len, uint16_t CRC);
 
 // validCRC #1: check the CRC in a message for validity
-  static bool validCRC(ModbusMessage msg);
+  static bool validCRC(const ModbusMessage& msg);
 
 // validCRC #2: check the CRC of a message against a given one
-  static bool validCRC(ModbusMessage msg, uint16_t CRC);
+  static bool validCRC(const ModbusMessage& msg, uint16_t CRC);
 
 // addCRC: extend a RTUMessage by a valid CRC
   static void addCRC(ModbusMessage& raw);
@@ -71,11 +74,32 @@ protected:
   RTUutils() = delete;
 
 // receive: get a Modbus message from serial, maintaining timeouts etc.
-  static ModbusMessage receive(uint8_t caller, Stream& serial, uint32_t timeout, unsigned long& lastMicros, uint32_t interval, bool ASCIImode, bool skipLeadingZeroBytes = false);
+// With predictLength, a RTU response is complete as soon as the length derived from its
+// function code has arrived. The interval gap still ends frames of other function codes.
+  static ModbusMessage receive(uint8_t caller, Stream& serial, uint32_t timeout, unsigned long& lastMicros, uint32_t interval, bool ASCIImode, bool skipLeadingZeroBytes = false, bool predictLength = false);
+  static void receive(uint8_t caller, Stream& serial, ModbusMessage& rv, uint32_t timeout, unsigned long& lastMicros, uint32_t interval, bool ASCIImode, bool skipLeadingZeroBytes = false, bool predictLength = false);
+
+// waitForData: sleep until data is available on serial or timeoutMicros have passed.
+// Returns true if there is data. With FreeRTOS the sleep is one tick at most, cut short by a
+// task notification from a receive callback. Linux will poll() the device.
+  static bool waitForData(Stream& serial, uint32_t timeoutMicros);
+
+// sleepMicros: wait for a number of microseconds, yielding the CPU for all whole ticks
+  static void sleepMicros(uint32_t us);
+
+// responseLength: expected length of a RTU response frame (including CRC) from its first bytes.
+// Returns 0 if not known (yet).
+  static uint16_t responseLength(const uint8_t *data, uint16_t len);
 
 // send: send a Modbus message in either format (ModbusMessage or data/len)
   static void send(Stream& serial, unsigned long& lastMicros, uint32_t interval, RTScallback r, const uint8_t *data, uint16_t len, bool ASCIImode);
-  static void send(Stream& serial, unsigned long& lastMicros, uint32_t interval, RTScallback r, ModbusMessage raw, bool ASCIImode);
+  static void send(Stream& serial, unsigned long& lastMicros, uint32_t interval, RTScallback r, ModbusMessage& raw, bool ASCIImode);
+
+// sendRTU: send a Modbus RTU message with a known CRC
+  static void sendRTU(Stream& serial, unsigned long& lastMicros, uint32_t interval, RTScallback r, ModbusMessage& raw, uint16_t crc16);
+
+// sendASCII: send a Modbus ASCII message, encoded in one buffer
+  static void sendASCII(Stream& serial, unsigned long& lastMicros, RTScallback r, ModbusMessage& raw);
 };
 
 #endif
@@ -0,0 +1,261 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _REQUEST_QUEUE_H
+#define _REQUEST_QUEUE_H
+#include <atomic>
+#include <memory>
+#include <new>
+#include <utility>
+#include <stdint.h>
+
+// IndexRing: bounded queue of slot numbers. Any number of threads may push and pop
+// at the same time without a lock (D. Vyukov's bounded MPMC queue).
+class IndexRing {
+public:
+  explicit IndexRing(uint32_t minSize) :
+    IR_mask(0),
+    IR_tail(0),
+    IR_head(0) {
+    // Size has to be a power of 2
+    uint32_t size = 1;
+    while (size < minSize) size <<= 1;
+    IR_mask = size - 1;
+    IR_cells.reset(new Cell[size]);
+    for (uint32_t i = 0; i < size; ++i) {
+      IR_cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // push: add a slot number at the end. Returns false if the ring is full.
+  bool push(uint32_t value) {
+    uint32_t pos = IR_tail.load(std::memory_order_relaxed);
+    while (1) {
+      Cell& c = IR_cells[pos & IR_mask];
+      int32_t dif = (int32_t)(c.seq.load(std::memory_order_acquire) - pos);
+      // Is the cell free?
+      if (dif == 0) {
+        // Yes. Claim it, unless another thread was faster
+        if (IR_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          c.value = value;
+          c.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      // No, ring is full
+      } else if (dif < 0) {
+        return false;
+      // No, another thread took it. Try the next one
+      } else {
+        pos = IR_tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // pop: take the first slot number. Returns false if the ring is empty.
+  // If position is given, it is set to the position the slot number was pushed to.
+  bool pop(uint32_t& value, uint32_t *position = nullptr) {
+    uint32_t pos = IR_head.load(std::memory_order_relaxed);
+    while (1) {
+      Cell& c = IR_cells[pos & IR_mask];
+      int32_t dif = (int32_t)(c.seq.load(std::memory_order_acquire) - (pos + 1));
+      // Does the cell hold a value?
+      if (dif == 0) {
+        // Yes. Take it, unless another thread was faster
+        if (IR_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          value = c.value;
+          c.seq.store(pos + IR_mask + 1, std::memory_order_release);
+          if (position) *position = pos;
+          return true;
+        }
+      // No, ring is empty
+      } else if (dif < 0) {
+        return false;
+      // No, another thread took it. Try the next one
+      } else {
+        pos = IR_head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // peek: look at the first slot number without taking it. Only safe if there is a single consumer!
+  bool peek(uint32_t& value) const {
+    uint32_t pos = IR_head.load(std::memory_order_relaxed);
+    const Cell& c = IR_cells[pos & IR_mask];
+    if (c.seq.load(std::memory_order_acquire) != pos + 1) return false;
+    value = c.value;
+    return true;
+  }
+
+  // head: position of the first slot number in the ring
+  inline uint32_t head() const { return IR_head.load(std::memory_order_acquire); }
+
+  // tail: position the next slot number will be pushed to
+  inline uint32_t tail() const { return IR_tail.load(std::memory_order_acquire); }
+
+  // size: number of slot numbers in the ring. Only a snapshot while other threads are using it.
+  uint32_t size() const {
+    // Head first - it never passes the tail
+    uint32_t head = IR_head.load(std::memory_order_acquire);
+    return IR_tail.load(std::memory_order_acquire) - head;
+  }
+
+protected:
+  struct Cell {
+    std::atomic<uint32_t> seq;   // Position the cell is ready for
+    uint32_t value;              // Slot number
+  };
+  std::unique_ptr<Cell[]> IR_cells;
+  uint32_t IR_mask;
+  // Keep producers and consumers off each other's cache line
+  uint8_t IR_pad0[64];
+  std::atomic<uint32_t> IR_tail;   // Next position to push to
+  uint8_t IR_pad1[64];
+  std::atomic<uint32_t> IR_head;   // Next position to pop from
+  uint8_t IR_pad2[64];
+
+  // Prevent copy construction or assignment
+  IndexRing(const IndexRing& other) = delete;
+  IndexRing& operator=(const IndexRing& other) = delete;
+};
+
+// RequestQueue: request queue of the clients. The entries are taken from a slab allocated
+// once for limit entries, so there is no new/delete per request. Producers in any number of
+// threads create() and push() entries without a lock, the client's worker as the single
+// consumer takes them with front()/pop() and gives them back with release().
+template <typename T>
+class RequestQueue {
+public:
+  explicit RequestQueue(uint32_t limit) :
+    RQ_limit(limit ? limit : 1),
+    RQ_slab(new Slot[RQ_limit]),
+    RQ_used(new bool[RQ_limit]),
+    RQ_position(new uint32_t[RQ_limit]),
+    RQ_free(RQ_limit),
+    RQ_queue(RQ_limit),
+    RQ_pending(0) {
+    for (uint32_t i = 0; i < RQ_limit; ++i) {
+      RQ_used[i] = false;
+      RQ_free.push(i);
+    }
+  }
+
+  ~RequestQueue() {
+    reset();
+  }
+
+  // create: construct an entry in a free slot. Returns nullptr if all slots are in use.
+  template <typename... Args>
+  T *create(Args&&... args) {
+    uint32_t i = 0;
+    if (!RQ_free.pop(i)) return nullptr;
+    T *entry = new (RQ_slab[i].data) T(std::forward<Args>(args)...);
+    RQ_used[i] = true;
+    RQ_pending++;
+    return entry;
+  }
+
+  // push: append an entry taken from create()
+  void push(T *entry) {
+    // There are as many places in the queue as there are slots, so it will always fit
+    RQ_queue.push(slotOf(entry));
+  }
+
+  // front: first entry in the queue, nullptr if there is none. Consumer only!
+  T *front() const {
+    uint32_t i = 0;
+    if (!RQ_queue.peek(i)) return nullptr;
+    return entryAt(i);
+  }
+
+  // pop: take the first entry out of the queue, nullptr if there is none. Consumer only!
+  T *pop() {
+    uint32_t i = 0;
+    uint32_t pos = 0;
+    if (!RQ_queue.pop(i, &pos)) return nullptr;
+    RQ_position[i] = pos;
+    return entryAt(i);
+  }
+
+  // release: destroy an entry and make its slot free again
+  void release(T *entry) {
+    uint32_t i = slotOf(entry);
+    entry->~T();
+    RQ_used[i] = false;
+    RQ_pending--;
+    RQ_free.push(i);
+  }
+
+  // clear: release all entries still in the queue. dropped, if given, is called for each
+  // of them before. Consumer only!
+  void clear(void (*dropped)(T *) = nullptr) {
+    T *entry = nullptr;
+    while ((entry = pop()) != nullptr) {
+      if (dropped) dropped(entry);
+      release(entry);
+    }
+  }
+
+  // mark: position behind the entries pushed so far, to clear() up to later
+  inline uint32_t mark() const { return RQ_queue.tail(); }
+
+  // clear: release the entries in the queue pushed before mark, calling dropped for them
+  // if given. Entries pushed later are kept, as are those still being pushed while the
+  // mark was taken. Consumer only!
+  void clear(uint32_t mark, void (*dropped)(T *) = nullptr) {
+    T *entry = nullptr;
+    while ((int32_t)(mark - RQ_queue.head()) > 0 && (entry = pop()) != nullptr) {
+      if (dropped) dropped(entry);
+      release(entry);
+    }
+  }
+
+  // before: true if entry had been pushed before mark. Only for entries taken with pop()!
+  inline bool before(T *entry, uint32_t mark) const {
+    return (int32_t)(mark - RQ_position[slotOf(entry)]) > 0;
+  }
+
+  // reset: release all entries, queued or not, calling dropped for them if given.
+  // No other thread may use the queue meanwhile!
+  void reset(void (*dropped)(T *) = nullptr) {
+    clear(dropped);
+    for (uint32_t i = 0; i < RQ_limit; ++i) {
+      if (RQ_used[i]) {
+        if (dropped) dropped(entryAt(i));
+        release(entryAt(i));
+      }
+    }
+  }
+
+  // empty: true if there is no entry in the queue
+  inline bool empty() const { return RQ_queue.size() == 0; }
+
+  // size: number of entries in the queue
+  inline uint32_t size() const { return RQ_queue.size(); }
+
+  // pending: number of entries created and not released yet - queued or being worked on
+  inline uint32_t pending() const { return RQ_pending.load(); }
+
+protected:
+  // Raw memory for one entry
+  struct Slot {
+    alignas(T) unsigned char data[sizeof(T)];
+  };
+
+  inline T *entryAt(uint32_t i) const { return reinterpret_cast<T *>(RQ_slab[i].data); }
+  inline uint32_t slotOf(T *entry) const { return reinterpret_cast<Slot *>(entry) - RQ_slab.get(); }
+
+  uint32_t RQ_limit;                    // Number of slots
+  std::unique_ptr<Slot[]> RQ_slab;      // The slots
+  std::unique_ptr<bool[]> RQ_used;      // Slots holding an entry
+  std::unique_ptr<uint32_t[]> RQ_position;  // Queue position of entries taken with pop()
+  IndexRing RQ_free;                    // Slots free to create() an entry
+  IndexRing RQ_queue;                   // Slots queued
+  std::atomic<uint32_t> RQ_pending;     // Number of slots in use
+
+  // Prevent copy construction or assignment
+  RequestQueue(const RequestQueue& other) = delete;
+  RequestQueue& operator=(const RequestQueue& other) = delete;
+};
+
+#endif  // _REQUEST_QUEUE_H
@@ -36,11 +36,15 @@ const unsigned int CLIENT_TASK_STACK = 4096;
 #include <wiringPi.h>
 #else
 #include <chrono>  // NOLINT
+#include <ctime>   // for nanosleep()
 // Use nanosleep() to avoid problems with pthreads (std::this_thread::sleep_for would interfere!)
 #define delay(x)  nanosleep((const struct timespec[]){{x/1000, (x%1000)*1000000L}}, NULL);
 typedef std::chrono::steady_clock clk;
 #define millis() std::chrono::duration_cast<std::chrono::milliseconds>(clk::now().time_since_epoch()).count()
 #define micros() std::chrono::duration_cast<std::chrono::microseconds>(clk::now().time_since_epoch()).count()
+#define delayMicroseconds(x)  do { struct timespec ts = { (time_t)((x)/1000000), (long)(((x)%1000000)*1000L) }; nanosleep(&ts, NULL); } while (0)
+#define HIGH 1
+#define LOW 0
 #endif
 
 #elif defined(ARDUINO_ARCH_RP2040)